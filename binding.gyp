@@ -2,7 +2,7 @@
   "targets": [
     {
       "target_name": "posixMq",
-      "sources": ["src/posix_mq.c", "src/errnoname.c"],
+      "sources": ["src/posix_mq.c", "src/chunk_pool.c", "src/io_pool.c", "src/notify_signal.c", "src/errnoname.c"],
       "cflags": ["-Wall", "-Werror", "-Wpedantic", "-Wextra"]
     }
   ]
@@ -1,3 +1,5 @@
+import { Readable } from 'node:stream';
+import { pipeline } from 'node:stream/promises';
 import tap from 'tap';
 
 import * as Pmq from './index.js';
@@ -6,6 +8,13 @@ function makeBiggestMq(name: Pmq.MqName, flags: Pmq.FopenFlags = "a+") {
   return new Pmq.PosixMq(name, flags, Pmq.MAX_MESSAGE_QUEUE_LENGTH, Pmq.MAX_MESSAGE_SIZE);
 }
 
+// Receiving from an empty blocking queue should wait out the timeout
+function receiveWaits(mq: Pmq.PosixMq): boolean {
+  const start = process.hrtime.bigint();
+  mq.receive(50);
+  return process.hrtime.bigint() - start >= 40_000_000n;
+}
+
 tap.test(
   "Test Posix Mq",
   async (tt) => {
@@ -51,5 +60,641 @@ tap.test(
           "Sent and received messages should be the same"
         );
       })
+
+      tt.test("Test Listening For Messages",
+      async (tt) => {
+        const mq = new Pmq.PosixMq(
+          "/testMq3",
+          "a+",
+          Pmq.MAX_MESSAGE_QUEUE_LENGTH,
+          sentMessage.length
+        );
+        const received = new Promise<Buffer[]>((resolve) => mq.once('messages', resolve));
+        mq.listen();
+        mq.send(sentMessage);
+        mq.send(sentMessage);
+        const messages = await received;
+        tt.equal(messages.length, 2, "All queued messages should be drained at once");
+        tt.equal(
+          messages[0].toString("utf8"),
+          sentMessage.toString("utf8"),
+          "Listened messages should match sent messages"
+        );
+        mq.close();
+        Pmq.PosixMq.unlink("/testMq3");
+      })
+
+      tt.test("Test Async Message Transmission",
+      async (tt) => {
+        const mq = new Pmq.PosixMq(
+          "/testMq4",
+          "a+",
+          Pmq.MAX_MESSAGE_QUEUE_LENGTH,
+          sentMessage.length,
+          true
+        );
+        const pendingReceive = mq.receiveAsync();
+        tt.ok(await mq.sendAsync(sentMessage), "Async send should be accepted");
+        const receivedMessage = await pendingReceive;
+        tt.equal(
+          receivedMessage?.toString("utf8"),
+          sentMessage.toString("utf8"),
+          "A blocking receive should resolve once a message is sent"
+        );
+        mq.close();
+        Pmq.PosixMq.unlink("/testMq4");
+      })
+
+      tt.test("Test Receiving Into A Buffer",
+      async (tt) => {
+        const mq = new Pmq.PosixMq(
+          "/testMq5",
+          "a+",
+          Pmq.MAX_MESSAGE_QUEUE_LENGTH,
+          sentMessage.length * 2
+        );
+        const target = Buffer.alloc(sentMessage.length * 3);
+        mq.send(sentMessage, 7);
+        const receivedLength = mq.receiveInto(target, sentMessage.length);
+        tt.equal(receivedLength, sentMessage.length, "Received length should be the sent length");
+        tt.equal(mq.lastPriority, 7, "Received priority should be the sent priority");
+        tt.equal(
+          target.subarray(sentMessage.length, sentMessage.length * 2).toString("utf8"),
+          sentMessage.toString("utf8"),
+          "Message should be written at the requested offset"
+        );
+        tt.equal(mq.receiveInto(target), undefined, "Receiving from an empty queue should return undefined");
+        tt.throws(
+          () => mq.receiveInto(target, sentMessage.length * 2),
+          "Should not be able to receive into less space than the max message size"
+        );
+        mq.close();
+        Pmq.PosixMq.unlink("/testMq5");
+      })
+
+      tt.test("Test Received Message Length",
+      async (tt) => {
+        const mq = new Pmq.PosixMq(
+          "/testMq6",
+          "a+",
+          Pmq.MAX_MESSAGE_QUEUE_LENGTH,
+          sentMessage.length * 4
+        );
+        mq.send(sentMessage);
+        mq.send(sentMessage.subarray(0, 3));
+        tt.equal(mq.receive()?.length, sentMessage.length, "Received message should have the sent length");
+        tt.equal(mq.receive()?.length, 3, "Short messages should not be padded to the max size");
+        mq.close();
+        Pmq.PosixMq.unlink("/testMq6");
+      })
+
+      tt.test("Test Received Message Priority",
+      async (tt) => {
+        const mq = new Pmq.PosixMq(
+          "/testMq7",
+          "a+",
+          Pmq.MAX_MESSAGE_QUEUE_LENGTH,
+          sentMessage.length
+        );
+        const priorities = new Int32Array(2);
+        mq.send(sentMessage, 1);
+        mq.send(sentMessage, 5);
+        mq.receive(undefined, priorities, 0);
+        mq.receive(undefined, priorities, 1);
+        tt.same(Array.from(priorities), [5, 1], "Messages should be received in priority order");
+
+        const received = new Promise<Uint32Array>(
+          (resolve) => mq.once('messages', (_messages, priorities) => resolve(priorities))
+        );
+        mq.listen();
+        mq.send(sentMessage, 2);
+        mq.send(sentMessage, 3);
+        tt.same(Array.from(await received), [3, 2], "Listened priorities should be reported per message");
+        mq.close();
+        Pmq.PosixMq.unlink("/testMq7");
+      })
+
+      tt.test("Test Receiving Many Messages",
+      async (tt) => {
+        const mq = new Pmq.PosixMq(
+          "/testMq8",
+          "a+",
+          Pmq.MAX_MESSAGE_QUEUE_LENGTH,
+          sentMessage.length
+        );
+        const priorities = new Uint32Array(2);
+        for (let priority = 0; priority < 3; priority++) {
+          mq.send(sentMessage, priority);
+        }
+        const firstBatch = mq.receiveMany(2, undefined, priorities);
+        tt.equal(firstBatch.length, 2, "Batch should stop at the requested maximum");
+        tt.same(Array.from(priorities), [2, 1], "Batch priorities should be reported in order");
+        tt.equal(
+          firstBatch[0].toString("utf8"),
+          sentMessage.toString("utf8"),
+          "Batched messages should match sent messages"
+        );
+        tt.equal(mq.receiveMany(2).length, 1, "Batch should stop when the queue is empty");
+        tt.same(mq.receiveMany(2), [], "Receiving from an empty queue should return no messages");
+        const otherMessage = Buffer.from("x".repeat(sentMessage.length));
+        mq.send(otherMessage);
+        const [heldMessage] = mq.receiveMany(1);
+        tt.same(firstBatch[1], sentMessage, "A held message should not be overwritten by later receives");
+        tt.same(heldMessage, otherMessage, "A later receive should get its own memory");
+        const stats = Pmq.PosixMq.allocatorStats();
+        tt.ok(stats.chunksInUse >= 2, "Held messages should be counted as chunks in use");
+        tt.ok(stats.peakChunksInUse >= stats.chunksInUse, "The high-water mark should cover current use");
+        tt.ok(stats.poolBytes >= stats.bytesInUse, "The pool should be at least as large as what is in use");
+        mq.send(sentMessage, 6);
+        const singleMessage = mq.receive();
+        tt.equal(
+          Pmq.PosixMq.allocatorStats().chunksInUse,
+          stats.chunksInUse + 1,
+          "A single receive should also hand out a pool chunk"
+        );
+        tt.same(singleMessage, sentMessage, "A single receive should get the sent message");
+        tt.equal(mq.lastPriority, 6, "A single receive should record the priority");
+        mq.close();
+        Pmq.PosixMq.unlink("/testMq8");
+      })
+
+      tt.test("Test Receiving A Packed Batch",
+      async (tt) => {
+        const mq = new Pmq.PosixMq(
+          "/testMq9",
+          "a+",
+          Pmq.MAX_MESSAGE_QUEUE_LENGTH,
+          sentMessage.length
+        );
+        const batch = new Pmq.MessageBatch(4, mq.maxMessageSize);
+        mq.send(sentMessage, 4);
+        mq.send(sentMessage.subarray(0, 5), 9);
+        mq.receiveBatch(batch);
+        tt.equal(batch.count, 2, "Batch should hold every queued message");
+        tt.same(Array.from(batch.lengths.subarray(0, 2)), [5, sentMessage.length], "Batch lengths should be exact");
+        tt.same(Array.from(batch.offsets.subarray(0, 2)), [0, 5], "Batch payloads should be packed back to back");
+        tt.same(Array.from(batch.priorities.subarray(0, 2)), [9, 4], "Batch priorities should be reported");
+        tt.equal(
+          Buffer.from(batch.message(1)).toString("utf8"),
+          sentMessage.toString("utf8"),
+          "Batch payloads should match sent messages"
+        );
+        tt.equal(mq.receiveBatch(batch).count, 0, "Receiving from an empty queue should give an empty batch");
+        mq.send(sentMessage);
+        tt.throws(
+          () => mq.receiveBatch(new Pmq.MessageBatch(1, mq.maxMessageSize - 1)),
+          /smaller than the max message size/,
+          "A batch that can't hold a message should throw"
+        );
+        tt.equal(mq.depth(), 1, "A batch that can't hold a message should leave the queue alone");
+        mq.close();
+        Pmq.PosixMq.unlink("/testMq9");
+      })
+
+      tt.test("Test Sending Many Messages",
+      async (tt) => {
+        const mq = new Pmq.PosixMq(
+          "/testMq10",
+          "a+",
+          2,
+          sentMessage.length
+        );
+        tt.equal(
+          mq.sendMany([sentMessage, sentMessage, sentMessage], new Uint32Array([1, 2, 3])),
+          2,
+          "Sending should stop once the queue is full"
+        );
+        const priorities = new Uint32Array(2);
+        tt.equal(mq.receiveMany(2, undefined, priorities).length, 2, "Every accepted message should be queued");
+        tt.same(Array.from(priorities), [2, 1], "Per-message priorities should be applied");
+        tt.equal(mq.sendMany([], 0), 0, "Sending no messages should send nothing");
+        tt.throws(() => mq.sendMany([sentMessage, "oops" as any]), "A non-binary message should throw");
+        tt.equal(mq.depth(), 0, "Nothing should be sent when any message is invalid");
+        tt.throws(
+          () => mq.sendMany([sentMessage, Buffer.alloc(mq.maxMessageSize + 1)]),
+          "An oversized message should throw"
+        );
+        tt.equal(mq.depth(), 0, "Nothing should be sent when any message is oversized");
+        mq.close();
+        Pmq.PosixMq.unlink("/testMq10");
+      })
+
+      tt.test("Test Sending A Multi-Part Message",
+      async (tt) => {
+        const mq = new Pmq.PosixMq(
+          "/testMq11",
+          "a+",
+          Pmq.MAX_MESSAGE_QUEUE_LENGTH,
+          sentMessage.length
+        );
+        const parts = [sentMessage.subarray(0, 4), sentMessage.subarray(4, 9), sentMessage.subarray(9)];
+        tt.ok(mq.sendv(parts, 3), "Multi-part send should be accepted");
+        tt.equal(
+          mq.receive()?.toString("utf8"),
+          sentMessage.toString("utf8"),
+          "Parts should be gathered into a single message"
+        );
+        tt.throws(
+          () => mq.sendv([sentMessage, sentMessage]),
+          "Should not be able to send parts larger than the max message size"
+        );
+        mq.close();
+        Pmq.PosixMq.unlink("/testMq11");
+      })
+
+      tt.test("Test Queue Attributes",
+      async (tt) => {
+        const mq = new Pmq.PosixMq(
+          "/testMq12",
+          "a+",
+          Pmq.MAX_MESSAGE_QUEUE_LENGTH,
+          sentMessage.length
+        );
+        mq.send(sentMessage);
+        const attributes = mq.attributes;
+        tt.equal(attributes.maxMessageSize, mq.maxMessageSize, "Cached message size should match the queue");
+        tt.equal(attributes.maxMessages, mq.maxMessages, "Cached queue length should match the queue");
+        tt.equal(attributes.currentMessageCount, 1, "Attributes should report the current message count");
+        tt.equal(mq.depth(), 1, "Depth should match the current message count");
+        const snapshot = mq.readAttributesInto(new BigInt64Array(Pmq.MQ_ATTRIBUTE_FIELDS + 1), 1);
+        tt.equal(
+          snapshot[1 + Pmq.MqAttributeIndex.maxMessageSize],
+          BigInt(mq.maxMessageSize),
+          "The snapshot should hold the message size at its offset"
+        );
+        tt.equal(
+          snapshot[1 + Pmq.MqAttributeIndex.currentMessageCount],
+          1n,
+          "The snapshot should hold the current message count at its offset"
+        );
+        tt.throws(() => mq.readAttributesInto(new BigInt64Array(3)), "A too small snapshot array should throw");
+        const stats = Pmq.PosixMq.statsMany(new Int32Array([mq.mqDescriptor!, -1]));
+        tt.equal(stats[Pmq.MqAttributeIndex.currentMessageCount], 1n, "Bulk stats should read each queue");
+        tt.ok(stats[Pmq.MQ_ATTRIBUTE_FIELDS + Pmq.MqAttributeIndex.flags] < 0n, "A bad descriptor should report an errno");
+        mq.close();
+        tt.throws(() => mq.attributes, "Should not be able to get attributes of a closed Mq");
+        tt.throws(() => mq.depth(), "Should not be able to get the depth of a closed Mq");
+        Pmq.PosixMq.unlink("/testMq12");
+      })
+
+      tt.test("Test Receive Timeouts",
+      async (tt) => {
+        const mq = new Pmq.PosixMq(
+          "/testMq13",
+          "a+",
+          Pmq.MAX_MESSAGE_QUEUE_LENGTH,
+          sentMessage.length,
+          true
+        );
+        const start = process.hrtime.bigint();
+        tt.equal(await mq.receiveAsync(20), undefined, "A timed out receive should resolve undefined");
+        tt.ok(process.hrtime.bigint() - start >= 20_000_000n, "A millisecond timeout should be waited out");
+        tt.same(mq.receiveMany(1, 1_000_000n), [], "A nanosecond timeout should be accepted");
+        mq.send(sentMessage);
+        tt.equal(mq.receiveMany(1, 0).length, 1, "A zero timeout should still receive a queued message");
+        tt.equal(
+          mq.receiveInto(new Uint8Array(mq.maxMessageSize), 0, 1),
+          undefined,
+          "A timed out receive into a buffer should give undefined"
+        );
+        tt.same(mq.receiveMany(1, NaN), [], "A NaN timeout should not wait");
+        tt.same(mq.receiveMany(1, -Infinity), [], "A negative infinite timeout should not wait");
+        tt.same(mq.receiveMany(1, -(2n ** 70n)), [], "An out of range negative timeout should not wait");
+        mq.close();
+        Pmq.PosixMq.unlink("/testMq13");
+      })
+
+      tt.test("Test Signal Notification",
+      async (tt) => {
+        const mq = new Pmq.PosixMq("/testMq19", "a+", 8, sentMessage.length);
+        const otherMq = new Pmq.PosixMq("/testMq20", "a+", 8, sentMessage.length);
+        mq.send(sentMessage);
+        let otherDrains = 0;
+        otherMq.on('messages', () => otherDrains++);
+        otherMq.listen({ mode: 'signal' });
+        const received: Buffer[] = [];
+        const firstDrain = new Promise((resolve) => mq.once('messages', resolve));
+        mq.on('messages', (messages: Buffer[]) => received.push(...messages));
+        mq.listen({ mode: 'signal' });
+        await firstDrain;
+        tt.equal(received.length, 1, "A message queued before listening should be drained");
+        const secondDrain = new Promise((resolve) => mq.once('messages', resolve));
+        mq.send(sentMessage);
+        await secondDrain;
+        tt.equal(received.length, 2, "A signal should drain the queue that fired");
+        mq.send(sentMessage);
+        await new Promise((resolve) => mq.once('messages', resolve));
+        tt.equal(received.length, 3, "Notification should be re-armed after each signal");
+        tt.equal(otherDrains, 0, "Other queues should not be woken");
+        mq.close();
+        otherMq.close();
+        Pmq.PosixMq.unlink("/testMq19");
+        Pmq.PosixMq.unlink("/testMq20");
+      })
+
+      tt.test("Test Thread Notification",
+      async (tt) => {
+        const mq = new Pmq.PosixMq("/testMq21", "a+", 8, sentMessage.length);
+        mq.send(sentMessage, 1);
+        const batches: Buffer[][] = [];
+        const priorities: number[] = [];
+        mq.on('messages', (messages: Buffer[], batchPriorities: Uint32Array) => {
+          batches.push(messages);
+          priorities.push(...batchPriorities);
+        });
+        const nextBatch = () => new Promise((resolve) => mq.once('messages', resolve));
+        let batch = nextBatch();
+        mq.listen({ mode: 'thread', batchSize: 2 });
+        await batch;
+        tt.equal(batches.length, 1, "A message queued before listening should be delivered");
+        batch = nextBatch();
+        mq.sendMany([sentMessage, sentMessage, sentMessage], 2);
+        await batch;
+        while (batches.flat().length < 4) {
+          await nextBatch();
+        }
+        tt.ok(batches.every((messages) => messages.length <= 2), "Batches should be bounded by the batch size");
+        tt.same(batches.flat()[3], sentMessage, "Delivered messages should match sent messages");
+        tt.same(priorities, [1, 2, 2, 2], "Priorities should be delivered with each batch");
+        mq.close();
+        Pmq.PosixMq.unlink("/testMq21");
+      })
+
+      tt.test("Test Async Iteration",
+      async (tt) => {
+        const mq = new Pmq.PosixMq("/testMq22", "a+", 8, sentMessage.length);
+        mq.sendMany([sentMessage, sentMessage], 1);
+        setTimeout(() => mq.sendMany([sentMessage, sentMessage, sentMessage]), 20);
+        const received: Buffer[] = [];
+        for await (const message of mq) {
+          received.push(message);
+          if (received.length === 5) {
+            break;
+          }
+        }
+        tt.equal(received.length, 5, "Messages sent before and during iteration should be yielded");
+        tt.same(received[4], sentMessage, "Yielded messages should match sent messages");
+        tt.throws(() => mq.batches({ batchSize: 0 }), "A non-positive batch size should throw");
+
+        mq.sendMany([sentMessage, sentMessage, sentMessage]);
+        for await (const message of mq) {
+          tt.same(message, sentMessage, "The first queued message should be yielded");
+          break;
+        }
+        tt.equal(mq.depth(), 2, "Stopping early should leave the other messages queued");
+        tt.equal(mq.receiveMany(2).length, 2, "Messages left after stopping early should still be received");
+
+        const batches: Buffer[][] = [];
+        const iteration = (async () => {
+          for await (const batch of mq.batches({ batchSize: 2 })) {
+            batches.push(batch);
+          }
+        })();
+        mq.sendMany([sentMessage, sentMessage, sentMessage]);
+        await new Promise((resolve) => setTimeout(resolve, 20));
+        mq.close();
+        await iteration;
+        tt.ok(batches.every((batch) => batch.length <= 2), "Batches should be bounded by the batch size");
+        tt.equal(batches.flat().length, 3, "Every queued message should be yielded before closing");
+        Pmq.PosixMq.unlink("/testMq22");
+
+        const blocking = new Pmq.PosixMq("/testMq28", "a+", 8, sentMessage.length, true);
+        setTimeout(() => blocking.send(sentMessage), 20);
+        for await (const message of blocking) {
+          tt.same(message, sentMessage, "A blocking queue should be iterable");
+          break;
+        }
+        tt.ok(receiveWaits(blocking), "Iterating should leave a blocking queue blocking");
+        blocking.close();
+        Pmq.PosixMq.unlink("/testMq28");
+      })
+
+      tt.test("Test Streams",
+      async (tt) => {
+        const mq = new Pmq.PosixMq("/testMq23", "a+", 2, 4);
+        const messages = Array.from({ length: 8 }, (_, i) => Buffer.from(`m${i}`));
+        const writable = mq.createWriteStream({ highWaterMark: 4 });
+        tt.throws(() => mq.createWriteStream(), "A queue should only have one write stream");
+        const written = pipeline(Readable.from(messages), writable);
+        await new Promise((resolve) => setTimeout(resolve, 20));
+        tt.equal(mq.depth(), 2, "Writes should wait while the queue is full");
+        tt.ok(writable.writableNeedDrain, "A full queue should push back on the writer");
+
+        const readable = mq.createReadStream({ highWaterMark: 3 });
+        tt.throws(() => mq.listen(), "A queue being streamed from can't also be listened to");
+        const received: Buffer[] = [];
+        readable.on('data', (message: Buffer) => received.push(message));
+        await written;
+        while (received.length < messages.length) {
+          await new Promise((resolve) => setImmediate(resolve));
+        }
+        tt.same(received, messages, "Every written message should be read in order");
+        const ended = new Promise((resolve) => readable.on('end', resolve));
+        mq.close();
+        await ended;
+        tt.pass("Closing the queue should end the read stream");
+        Pmq.PosixMq.unlink("/testMq23");
+
+        const blocking = new Pmq.PosixMq("/testMq29", "a+", 2, 4, true);
+        const blockingWritable = blocking.createWriteStream();
+        const blockingWritten = pipeline(Readable.from(messages.slice(0, 3)), blockingWritable);
+        await new Promise((resolve) => setTimeout(resolve, 20));
+        tt.equal(blocking.depth(), 2, "Writes to a full blocking queue should wait");
+        const blockingReadable = blocking.createReadStream();
+        const blockingReceived: Buffer[] = [];
+        blockingReadable.on('data', (message: Buffer) => blockingReceived.push(message));
+        await blockingWritten;
+        while (blockingReceived.length < 3) {
+          await new Promise((resolve) => setImmediate(resolve));
+        }
+        blockingReadable.destroy();
+        tt.same(blockingReceived, messages.slice(0, 3), "A blocking queue should be streamed through");
+        tt.ok(receiveWaits(blocking), "Streaming should leave a blocking queue blocking");
+        blocking.close();
+        Pmq.PosixMq.unlink("/testMq29");
+      })
+
+      tt.test("Test Web Byte Stream",
+      async (tt) => {
+        const mq = new Pmq.PosixMq("/testMq24", "a+", 8, 8);
+        const frames = new Float64Array([1.5, -2.25, 3]);
+        for (const frame of frames) {
+          mq.send(new Float64Array([frame]));
+        }
+        const reader = mq.readableWebStream().getReader({ mode: 'byob' });
+        tt.throws(() => mq.createReadStream(), "A queue being streamed from can't be streamed from twice");
+        const decoded: number[] = [];
+        let buffer = new ArrayBuffer(8);
+        for (let i = 0; i < frames.length; i++) {
+          const { value } = await reader.read(new Float64Array(buffer));
+          decoded.push(value![0]);
+          buffer = value!.buffer;
+        }
+        tt.same(decoded, Array.from(frames), "Each message should be received into the caller's view");
+
+        setTimeout(() => mq.send(Buffer.from("abcdef")), 20);
+        const head = await reader.read(new Uint8Array(4));
+        tt.same(Buffer.from(head.value!), Buffer.from("abcd"), "A view smaller than a message should be filled");
+        const tail = await reader.read(new Uint8Array(8));
+        tt.same(Buffer.from(tail.value!), Buffer.from("ef"), "The rest of the message should follow");
+
+        const pending = reader.read(new Uint8Array(8));
+        mq.close();
+        tt.ok((await pending).done, "Closing the queue should close the stream");
+        Pmq.PosixMq.unlink("/testMq24");
+
+        const blocking = new Pmq.PosixMq("/testMq30", "a+", 8, 8, true);
+        const blockingReader = blocking.readableWebStream().getReader({ mode: 'byob' });
+        setTimeout(() => blocking.send(Buffer.from("abc")), 20);
+        const { value } = await blockingReader.read(new Uint8Array(8));
+        tt.same(Buffer.from(value!), Buffer.from("abc"), "A blocking queue should be readable as a byte stream");
+        await blockingReader.cancel();
+        tt.ok(receiveWaits(blocking), "Streaming bytes should leave a blocking queue blocking");
+        blocking.close();
+        Pmq.PosixMq.unlink("/testMq30");
+      })
+
+      tt.test("Test Thread Notification Backpressure",
+      async (tt) => {
+        const mq = new Pmq.PosixMq("/testMq27", "a+", 4, sentMessage.length);
+        const received: Buffer[] = [];
+        mq.on('messages', (messages: Buffer[]) => received.push(...messages));
+        const stall = (milliseconds: number) => {
+          const end = Date.now() + milliseconds;
+          while (Date.now() < end);
+        };
+        // Listening takes these in one batch, which JS can't take while stalled
+        mq.sendMany([sentMessage, sentMessage]);
+        mq.listen({ mode: 'thread', batchSize: 2 });
+        let accepted = 0;
+        for (let i = 0; i < 8; i++) {
+          if (mq.trySend(sentMessage)) {
+            accepted++;
+          }
+          stall(10);
+        }
+        tt.equal(accepted, 4, "A stalled event loop should leave the queue to fill up");
+        while (received.length < 6) {
+          await new Promise((resolve) => mq.once('messages', resolve));
+        }
+        tt.equal(received.length, 6, "Every accepted message should be delivered once the loop runs");
+        mq.close();
+        Pmq.PosixMq.unlink("/testMq27");
+      })
+
+      tt.test("Test Parallel Blocking Operations",
+      async (tt) => {
+        const mq = new Pmq.PosixMq("/testMq18", "a+", 8, sentMessage.length, true);
+        Pmq.PosixMq.setIoThreads(8);
+        const start = process.hrtime.bigint();
+        const timedOut = await Promise.all(Array.from({ length: 6 }, () => mq.receiveAsync(300)));
+        const elapsed = process.hrtime.bigint() - start;
+        tt.same(timedOut, Array(6).fill(undefined), "Every waiting receive should time out");
+        tt.ok(elapsed < 550_000_000n, "Waiting receives should not queue behind each other");
+        const waiting = Array.from({ length: 3 }, () => mq.receiveAsync());
+        for (let i = 0; i < 3; i++) {
+          await mq.sendAsync(sentMessage);
+        }
+        tt.equal((await Promise.all(waiting)).length, 3, "Sends should wake the waiting receives");
+        tt.throws(() => Pmq.PosixMq.setIoThreads(0), "The thread count should be positive");
+        Pmq.PosixMq.setIoThreads(4);
+        mq.close();
+        Pmq.PosixMq.unlink("/testMq18");
+      })
+
+      tt.test("Test Closing With Pending Operations",
+      async (tt) => {
+        Pmq.PosixMq.setIoThreads(1);
+        const mq = new Pmq.PosixMq("/testMq25", "a+", 1, sentMessage.length, true);
+        const running = mq.receiveAsync();
+        const queued = mq.receiveAsync(300);
+        await new Promise((resolve) => setTimeout(resolve, 20));
+        mq.close();
+        await tt.rejects(running, "A running receive should be rejected when the queue is closed");
+        await tt.rejects(queued, "A queued receive should be rejected when the queue is closed");
+
+        const closing = new Pmq.PosixMq("/testMq25", "a+", 1, sentMessage.length, true);
+        const waiting = closing.receiveAsync(300);
+        closing.close();
+        const other = new Pmq.PosixMq("/testMq26", "a+", 1, sentMessage.length, true);
+        other.send(sentMessage);
+        await tt.rejects(waiting, "A receive on a closed queue should not receive from another queue");
+        tt.same(other.receive(), sentMessage, "The other queue should keep its message");
+        other.close();
+        Pmq.PosixMq.setIoThreads(4);
+        Pmq.PosixMq.unlink("/testMq25");
+        Pmq.PosixMq.unlink("/testMq26");
+      })
+
+      tt.test("Test String Messages",
+      async (tt) => {
+        const mq = new Pmq.PosixMq("/testMq16", "a+", 4, 8);
+        tt.equal(mq.sendString("{\"a\":1}", 2), true, "A string should be sent");
+        tt.equal(mq.receiveString(), "{\"a\":1}", "The string should be received unchanged");
+        tt.equal(mq.lastPriority, 2, "The received priority should be recorded");
+        tt.equal(mq.sendString("h\u00e9llo"), true, "A multi-byte string that fits should be sent");
+        tt.equal(mq.receive()!.toString("utf8"), "h\u00e9llo", "The string should be sent as UTF-8");
+        tt.throws(() => mq.sendString("\u00e9\u00e9\u00e9\u00e9\u00e9"), "A string over the size limit should throw");
+        tt.equal(mq.receiveString(), undefined, "An oversized string should not be sent truncated");
+        mq.close();
+        Pmq.PosixMq.unlink("/testMq16");
+      })
+
+      tt.test("Test Sending Typed Views",
+      async (tt) => {
+        const mq = new Pmq.PosixMq("/testMq17", "a+", 8, 16);
+        const frame = new Float64Array([1.5, -2.25]);
+        tt.ok(mq.send(frame), "A Float64Array should be sent");
+        tt.same(
+          new Float64Array(Uint8Array.from(mq.receive()!).buffer),
+          frame,
+          "The Float64Array bytes should be received unchanged"
+        );
+        const bytes = Uint8Array.from([0, 1, 2, 3, 4, 5, 6, 7]);
+        tt.ok(mq.send(new DataView(bytes.buffer, 2, 3)), "A DataView should be sent");
+        tt.same(Array.from(mq.receive()!), [2, 3, 4], "Only the bytes the DataView covers should be sent");
+        tt.ok(mq.send(bytes.subarray(5)), "A subarray should be sent");
+        tt.same(Array.from(mq.receive()!), [5, 6, 7], "Only the bytes the subarray covers should be sent");
+        tt.ok(mq.send(bytes.buffer), "An ArrayBuffer should be sent");
+        tt.equal(mq.receive()!.length, 8, "The whole ArrayBuffer should be sent");
+        tt.ok(await mq.sendAsync(new Uint16Array([258])), "A view should be sent asynchronously");
+        tt.same(Array.from(mq.receive()!), [2, 1], "The async send should carry the view's bytes");
+        tt.throws(() => mq.send("text" as any), "A non-binary message should throw");
+        mq.close();
+        Pmq.PosixMq.unlink("/testMq17");
+      })
+
+      tt.test("Test Error Codes",
+      async (tt) => {
+        tt.throws(
+          () => Pmq.PosixMq.unlink("/testMq14"),
+          /no message queue with name/,
+          "Unlinking a missing queue should map ENOENT to a readable error"
+        );
+        tt.doesNotThrow(() => Pmq.PosixMq.unlink("/testMq14", true), "A forced unlink should ignore ENOENT");
+        tt.throws(
+          () => new Pmq.PosixMq("/testMq14", "r", 1, 1),
+          /error code: ENOENT/,
+          "Opening a missing queue should report the errno name"
+        );
+      })
+
+      tt.test("Test Non-Throwing Fast Paths",
+      async (tt) => {
+        const mq = new Pmq.PosixMq("/testMq15", "a+", 1, sentMessage.length);
+        tt.equal(mq.tryReceive(), null, "An empty queue should return null");
+        tt.equal(mq.receive(), undefined, "A non-blocking receive on an empty queue should not throw");
+        tt.equal(mq.trySend(sentMessage, 3), true, "A send to a queue with room should succeed");
+        tt.equal(mq.trySend(sentMessage), false, "A full queue should return false");
+        tt.equal(mq.send(sentMessage), false, "A non-blocking send to a full queue should not throw");
+        tt.same(mq.tryReceive(), sentMessage, "The queued message should be received");
+        tt.equal(mq.lastPriority, 3, "The received priority should be recorded");
+        mq.close();
+
+        const blockingMq = new Pmq.PosixMq("/testMq15", "a+", 1, sentMessage.length, true);
+        tt.equal(blockingMq.tryReceive(), null, "A blocking queue should not block on an empty queue");
+        blockingMq.close();
+        Pmq.PosixMq.unlink("/testMq15");
+      })
   }
 )
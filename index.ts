@@ -1,8 +1,12 @@
 import { EventEmitter } from 'node:events';
 import fs from 'node:fs';
 import { createRequire } from 'node:module';
+import os from 'node:os';
+import { Readable, Writable } from 'node:stream';
+import { ReadableStream, type ReadableByteStreamController } from 'node:stream/web';
 
 const fileConstants = fs.constants;
+const { EAGAIN, EBADF, EMSGSIZE, ETIMEDOUT } = os.constants.errno;
 
 const MSG_MAX_PATH = "/proc/sys/fs/mqueue/msg_max";
 export const MAX_MESSAGE_QUEUE_LENGTH = parseInt(
@@ -16,37 +20,142 @@ export const MAX_MESSAGE_SIZE = parseInt(
 
 export type MqName = `/${string}`
 
-export interface TimeSpec {
-  seconds: number,
-  nanoseconds: number
+export type Timeout = number | bigint;
+// Messages are sent straight from the bytes the view covers, without copying
+export type MessageData = ArrayBufferView | ArrayBuffer;
+export type PriorityArray = Int32Array | Uint32Array;
+
+export interface MqAttributes {
+  flags: number; 
+  maxMessages: number; 
+  maxMessageSize: number; 
+  currentMessageCount: number
 }
+
+// Layout of the attributes written by readAttributesInto()
+export const MqAttributeIndex = {
+  flags: 0,
+  maxMessages: 1,
+  maxMessageSize: 2,
+  currentMessageCount: 3
+} as const;
+export const MQ_ATTRIBUTE_FIELDS = 4;
+
+// Native pool backing received message Buffers, shared by every queue.
+// Slabs are never given back while the module is loaded, so poolBytes
+// stays at the most the pool has ever needed at once.
+export interface AllocatorStats {
+  poolBytes: number;
+  chunks: number;
+  chunksInUse: number;
+  peakChunksInUse: number;
+  bytesInUse: number;
+  peakBytesInUse: number
+}
+
+export interface NativeMq {
+  readonly descriptor: number,
+  readonly flags: number,
+  readonly maxMessages: number,
+  readonly maxMessageSize: number,
+  close: () => number | null,
+  attributes: () => MqAttributes | number,
+  readAttributesInto: (out: BigInt64Array, offset: number) => number | null,
+  depth: () => number,
+  send: (
+    message: MessageData, 
+    priority: number, 
+    timeout?: Timeout
+  ) => number | null,
+  trySend: (message: MessageData, priority: number) => boolean | number,
+  sendMany: (
+    messages: MessageData[], 
+    priorities?: PriorityArray | number, 
+    timeout?: Timeout
+  ) => number | [number, number],
+  sendv: (
+    parts: MessageData[], 
+    priority: number, 
+    timeout?: Timeout
+  ) => number | null,
+  sendString: (
+    message: string, 
+    priority: number, 
+    timeout?: Timeout
+  ) => number | null,
+  sendAsync: (
+    message: MessageData, 
+    priority: number, 
+    timeout?: Timeout
+  ) => Promise<number | null>,
+  receive: (
+    priorities: PriorityArray, 
+    priorityIndex: number, 
+    timeout?: Timeout
+  ) => Buffer | number,
+  receiveString: (
+    priorities: PriorityArray, 
+    priorityIndex: number, 
+    timeout?: Timeout
+  ) => string | number,
+  receiveInto: (
+    target: Uint8Array, 
+    offset: number, 
+    priorities: PriorityArray, 
+    priorityIndex: number, 
+    timeout?: Timeout
+  ) => number,
+  tryReceiveInto: (
+    target: Uint8Array, 
+    offset: number, 
+    priorities: PriorityArray, 
+    priorityIndex: number
+  ) => number | null,
+  receiveMany: (
+    maxMessages: number, 
+    priorities?: PriorityArray, 
+    timeout?: Timeout
+  ) => Buffer[] | number,
+  receiveBatch: (
+    data: Uint8Array, 
+    offsets: Uint32Array, 
+    lengths: Uint32Array, 
+    priorities: Uint16Array, 
+    timeout?: Timeout
+  ) => number,
+  receiveAsync: (
+    priorities: PriorityArray, 
+    priorityIndex: number, 
+    timeout?: Timeout
+  ) => Promise<Buffer | number>,
+  notify: (callback: (status: number) => void) => number | null,
+  notifyThread: (
+    maxBatch: number,
+    callback: (status: number, messages: Buffer[], priorities: Uint32Array) => void
+  ) => number | null,
+  watch: (
+    events: number,
+    callback: (status: number, events: number) => void
+  ) => number | null,
+  unwatch: () => null,
+  unnotify: () => null
+}
+
 export interface LowLevelMq {
   openPosixMq: (
     name: MqName, 
     oflags: number, 
     maxMessages: number, 
     maxMessageSize: number
-  ) => number | string,
-  closePosixMq: (mqDescriptor: number) => string | null,
-  sendPosixMq: (
-    mqDescriptor: number, 
-    message: Buffer, 
-    priority: number, 
-    timeout?: TimeSpec
-  ) => string | null,
-  receivePosixMq: (
-    mqDescriptor: number, 
-    messageLength: number, 
-    timeout?: TimeSpec
-  ) => Buffer | string,
-  posixMqAttributes: (mqDescriptor: number) => {
-    flags: number; 
-    maxMessages: number; 
-    maxMessageSize: number; 
-    currentMessageCount: number
-  },
-  posixMqNotify: (mqDescriptor: number) => string | null,
-  posixMqUnlink: (mqName: string) => null
+  ) => NativeMq | number,
+  posixMqUnlink: (mqName: string) => number | null,
+  statsMany: (descriptors: Int32Array, out: BigInt64Array) => number,
+  allocatorStats: () => AllocatorStats,
+  setIoThreads: (threadCount: number) => void,
+  errnoName: (errno: number) => string,
+  NOTIFY_SIGNAL: number,
+  POLL_READABLE: number,
+  POLL_WRITABLE: number
 }
 
 const require = createRequire(import.meta.filename);
@@ -54,15 +163,10 @@ const LowLevelPosixMq: LowLevelMq = require(
   `../build/${process.env.NODE_ENV === "dev" ? "Debug" : "Release"}/posixMq.node`
 );
 
-export type FopenFlags = "r" | "a" | "r+" | "a+";
+// Realtime signal used by listen({ mode: 'signal' })
+export const NOTIFY_SIGNAL = LowLevelPosixMq.NOTIFY_SIGNAL;
 
-function makeTimespec(posixTimeMs: number) {
-  const posixTimeSeconds = posixTimeMs / 1000.0;
-  return {
-    seconds: Math.floor(posixTimeSeconds),
-    nanoseconds: Math.round(posixTimeSeconds % 1000 * 1E9)
-  };
-}
+export type FopenFlags = "r" | "a" | "r+" | "a+";
 
 function fileFlagsToOflags(flags: FopenFlags | number): number {
   let oflags: number;
@@ -106,15 +210,92 @@ function validateMqName(name: MqName) {
   }
 }
 
+function errnoName(errorCode: number): string {
+  return LowLevelPosixMq.errnoName(-errorCode);
+}
+
 function throwCError(message: string, code: string) {
   throw new Error(`error: ${message}: error code: ${code}`);
 }
 
+export class MessageBatch {
+  readonly data: ArrayBuffer;
+  readonly bytes: Uint8Array;
+  readonly offsets: Uint32Array;
+  readonly lengths: Uint32Array;
+  readonly priorities: Uint16Array;
+  count: number = 0;
+
+  constructor(capacity: number, maxMessageSize: number) {
+    if (capacity <= 0) {
+      throw new Error("error: batch capacity must be greater than zero");
+    }
+    this.data = new ArrayBuffer(capacity * maxMessageSize);
+    this.bytes = new Uint8Array(this.data);
+    this.offsets = new Uint32Array(capacity);
+    this.lengths = new Uint32Array(capacity);
+    this.priorities = new Uint16Array(capacity);
+  }
+
+  get capacity(): number {
+    return this.offsets.length;
+  }
+
+  message(index: number): Uint8Array {
+    if (index < 0 || index >= this.count) {
+      throw new RangeError(`error: message index ${index} is outside of a batch of ${this.count} messages`);
+    }
+    return this.bytes.subarray(this.offsets[index], this.offsets[index] + this.lengths[index]);
+  }
+}
+
+export interface ListenOptions {
+  packed?: boolean,
+  // 'poll' watches the queue descriptor on the event loop. 'signal' uses
+  // mq_notify with NOTIFY_SIGNAL, whose handler this module installs for
+  // the whole process. 'thread' uses mq_notify with SIGEV_THREAD and
+  // receives off the JS thread, in batches of up to batchSize messages,
+  // waiting for each batch to be delivered before receiving the next.
+  mode?: 'poll' | 'signal' | 'thread',
+  batchSize?: number
+}
+
+async function* flattenBatches(batches: AsyncIterable<Buffer[]>): AsyncGenerator<Buffer, void, undefined> {
+  for await (const batch of batches) {
+    yield* batch;
+  }
+}
+
+export interface IterateOptions {
+  batchSize?: number
+}
+
+export interface ReadStreamOptions {
+  // In messages
+  highWaterMark?: number
+}
+
+export interface WriteStreamOptions {
+  // In bytes
+  highWaterMark?: number,
+  priority?: number
+}
+
 export class PosixMq extends EventEmitter {
   mqDescriptor: number | null = null;
   readonly flags: number;
   readonly maxMessages: number;
   readonly maxMessageSize: number;
+  #handle: NativeMq | null = null;
+  #listening: boolean = false;
+  readonly #receivedPriority = new Uint32Array(1);
+  #drainPriorities: Uint32Array;
+  #listenBatch: MessageBatch | null = null;
+  #notifying: boolean = false;
+  #reading: boolean = false;
+  #writing: boolean = false;
+  #onReadable: ((status: number) => void) | null = null;
+  #onWritable: ((status: number) => void) | null = null;
 
   constructor(
     name: MqName, 
@@ -157,11 +338,9 @@ export class PosixMq extends EventEmitter {
 
     const messageQueueOpenResult = LowLevelPosixMq.openPosixMq(name, oflags, maxMessages, messageSize);
     if (typeof messageQueueOpenResult === 'number') {
-      this.mqDescriptor = messageQueueOpenResult;
-    }
-    else if (typeof messageQueueOpenResult === 'string') {
-      const throwOpenError = (message: string) => throwCError(`unable to open message queue: ${message}`, messageQueueOpenResult);
-      switch (messageQueueOpenResult) {
+      const openErrorName = errnoName(messageQueueOpenResult);
+      const throwOpenError = (message: string) => throwCError(`unable to open message queue: ${message}`, openErrorName);
+      switch (openErrorName) {
         case "EACCES":
           throwOpenError(
             "caller does not have permission to open in the specified mode"
@@ -193,121 +372,874 @@ export class PosixMq extends EventEmitter {
       }
     }
     
-    this.flags = this.attributes.flags;
-    this.maxMessages = this.attributes.maxMessages;
-    this.maxMessageSize = this.attributes.maxMessageSize;
+    const handle = messageQueueOpenResult as NativeMq;
+    this.#handle = handle;
+    this.mqDescriptor = handle.descriptor;
+    this.flags = handle.flags;
+    this.maxMessages = handle.maxMessages;
+    this.maxMessageSize = handle.maxMessageSize;
+    this.#drainPriorities = new Uint32Array(this.maxMessages);
     
   }
   
-  listen() {
-    if (this.mqDescriptor === null) {
+  listen(options: ListenOptions = {}) {
+    if (this.#handle === null) {
       throw new Error("error: can't listen to a closed message queue");
     }
     if (this.blockingIo === true) {
       throw new Error("error: can't listen for messages when IO is blocking");
     }
-    process.on('SIGUSR2', () => {
-      const messages: Buffer[] = [];
-      let nextMessage: Buffer | undefined;
-      while ((nextMessage = this.receive()) !== undefined) {
-        messages.push(nextMessage);
+    if (this.#listening) {
+      return;
+    }
+    if (this.#reading) {
+      throw new Error("error: can't listen to a message queue that is already being read from");
+    }
+    const drain = () => {
+      if (options.packed) {
+        this.#emitBatches();
+        return;
+      }
+      let messages: Buffer[];
+      do {
+        messages = this.receiveMany(this.maxMessages, undefined, this.#drainPriorities);
+        if (messages.length > 0) {
+          this.emit('messages', messages, this.#drainPriorities.slice(0, messages.length));
+        }
+      } while (messages.length === this.maxMessages && this.#handle !== null);
+    };
+
+    if (options.mode === 'thread') {
+      if (options.packed) {
+        throw new Error("error: packed batches are not supported when listening on a notification thread");
+      }
+      const notifyResult = this.#handle.notifyThread(
+        options.batchSize ?? this.maxMessages,
+        (status, messages, priorities) => {
+          if (status < 0) {
+            this.emit('error', new Error(`error: unable to receive notified messages: error code: ${errnoName(status)}`));
+          }
+          if (messages.length > 0) {
+            this.emit('messages', messages, priorities);
+          }
+        }
+      );
+      if (typeof notifyResult === 'number') {
+        throw new Error(`error: unable to listen to message queue: error code: ${errnoName(notifyResult)}`);
+      }
+      this.#listening = true;
+      this.#notifying = true;
+      return;
+    }
+
+    if (options.mode === 'signal') {
+      const notifyResult = this.#handle.notify((status) => {
+        if (status < 0) {
+          this.emit('error', new Error(`error: unable to re-arm message queue notification: error code: ${errnoName(status)}`));
+        }
+        drain();
+      });
+      if (typeof notifyResult === 'number') {
+        throw new Error(`error: unable to listen to message queue: error code: ${errnoName(notifyResult)}`);
+      }
+      // Notifications only fire when an empty queue becomes non-empty
+      process.nextTick(() => {
+        if (this.#listening) {
+          drain();
+        }
+      });
+      this.#listening = true;
+      this.#notifying = true;
+      return;
+    }
+
+    this.#watch(LowLevelPosixMq.POLL_READABLE, (status) => {
+      if (status < 0) {
+        this.emit('error', new Error(`error: unable to poll message queue: error code: ${errnoName(status)}`));
+        return;
       }
-      this.emit('messages', messages)
-    })
+      drain();
+    });
+    this.#listening = true;
   }
-  
 
-  
-  get attributes() {
-    if (this.mqDescriptor === null) {
+  #emitBatches() {
+    if (this.#listenBatch === null) {
+      this.#listenBatch = new MessageBatch(this.maxMessages, this.maxMessageSize);
+    }
+    const batch = this.#listenBatch;
+    do {
+      this.receiveBatch(batch);
+      if (batch.count > 0) {
+        this.emit('batch', batch);
+      }
+    } while (batch.count === batch.capacity && this.#handle !== null);
+  }
+
+  unlisten() {
+    if (this.#listening && this.#handle !== null) {
+      if (this.#notifying) {
+        this.#handle.unnotify();
+      }
+      else {
+        this.#watch(LowLevelPosixMq.POLL_READABLE, null);
+      }
+    }
+    this.#listening = false;
+    this.#notifying = false;
+  }
+
+  // The native side keeps a single poll handle per queue, so whatever is
+  // waiting to read and whatever is waiting to write share it
+  #watch(events: number, callback: ((status: number) => void) | null) {
+    if (events === LowLevelPosixMq.POLL_READABLE) {
+      this.#onReadable = callback;
+    }
+    else {
+      this.#onWritable = callback;
+    }
+    if (this.#handle === null) {
+      return;
+    }
+
+    const watchedEvents =
+      (this.#onReadable !== null ? LowLevelPosixMq.POLL_READABLE : 0) |
+      (this.#onWritable !== null ? LowLevelPosixMq.POLL_WRITABLE : 0);
+    if (watchedEvents === 0) {
+      this.#handle.unwatch();
+      return;
+    }
+    const watchResult = this.#handle.watch(watchedEvents, (status, readyEvents) => {
+      if (status < 0 || (readyEvents & LowLevelPosixMq.POLL_READABLE)) {
+        this.#onReadable?.(status);
+      }
+      if (status < 0 || (readyEvents & LowLevelPosixMq.POLL_WRITABLE)) {
+        this.#onWritable?.(status);
+      }
+    });
+    if (typeof watchResult === 'number') {
+      this.#onReadable = this.#onWritable = null;
+      throw new Error(`error: unable to watch message queue: error code: ${errnoName(watchResult)}`);
+    }
+  }
+
+  [Symbol.asyncIterator](): AsyncGenerator<Buffer, void, undefined> {
+    return this.messages();
+  }
+
+  // Yields messages as the queue descriptor becomes readable. Nothing is
+  // received until the consumer asks for it, so a consumer that stops
+  // early leaves the rest of the queue alone. Iteration ends when the
+  // queue is closed.
+  messages(): AsyncGenerator<Buffer, void, undefined> {
+    if (this.#handle === null) {
+      throw new Error("error: can't iterate over a closed message queue");
+    }
+    return flattenBatches(this.#receiveBatches(1));
+  }
+
+  // Like messages(), but each step receives as many queued messages as it
+  // can, up to batchSize, and yields them together
+  batches(options: IterateOptions = {}): AsyncGenerator<Buffer[], void, undefined> {
+    const batchSize = options.batchSize ?? this.maxMessages;
+    if (! Number.isInteger(batchSize) || batchSize <= 0) {
+      throw new RangeError(`error: the batch size must be a positive integer: ${batchSize}`);
+    }
+    if (this.#handle === null) {
+      throw new Error("error: can't iterate over a closed message queue");
+    }
+    return this.#receiveBatches(batchSize);
+  }
+
+  async *#receiveBatches(batchSize: number): AsyncGenerator<Buffer[], void, undefined> {
+    if (this.#listening || this.#reading) {
+      throw new Error("error: can't iterate over a message queue that is already being read from");
+    }
+
+    let wake: (() => void) | null = null;
+    const onClose = () => wake?.();
+    this.#reading = true;
+    this.once('close', onClose);
+    try {
+      for (;;) {
+        if (this.#handle === null) {
+          return;
+        }
+        const batch = this.receiveMany(batchSize, 0);
+        if (batch.length > 0) {
+          yield batch;
+          continue;
+        }
+
+        const status = await new Promise<number>((resolve) => {
+          wake = () => resolve(0);
+          this.#watch(LowLevelPosixMq.POLL_READABLE, resolve);
+        });
+        wake = null;
+        this.#watch(LowLevelPosixMq.POLL_READABLE, null);
+        if (status < 0) {
+          throw new Error(`error: unable to poll message queue: error code: ${errnoName(status)}`);
+        }
+      }
+    }
+    finally {
+      this.#reading = false;
+      this.off('close', onClose);
+    }
+  }
+
+  // Messages are received in batches of up to highWaterMark whenever the
+  // stream wants more and the queue has them; otherwise the descriptor is
+  // watched until it becomes readable. The stream ends when the queue is
+  // closed.
+  createReadStream(options: ReadStreamOptions = {}): Readable {
+    const highWaterMark = options.highWaterMark ?? this.maxMessages;
+    if (! Number.isInteger(highWaterMark) || highWaterMark <= 0) {
+      throw new RangeError(`error: the high water mark must be a positive integer: ${highWaterMark}`);
+    }
+    if (this.#handle === null) {
+      throw new Error("error: can't read from a closed message queue");
+    }
+    if (this.#listening || this.#reading) {
+      throw new Error("error: can't stream from a message queue that is already being read from");
+    }
+
+    let watching = false;
+    const stopWatching = () => {
+      if (watching) {
+        this.#watch(LowLevelPosixMq.POLL_READABLE, null);
+      }
+      watching = false;
+    };
+    const onClose = () => {
+      stopWatching();
+      stream.push(null);
+    };
+    // Called when the stream wants more and again once the descriptor is
+    // readable, since the stream won't ask twice before anything is pushed
+    const pull = (size: number) => {
+      stopWatching();
+      try {
+        for (;;) {
+          if (this.#handle === null) {
+            stream.push(null);
+            return;
+          }
+          const batch = this.receiveMany(Math.min(size, this.maxMessages), 0);
+          if (batch.length === 0) {
+            break;
+          }
+          let wantsMore = true;
+          for (const message of batch) {
+            wantsMore = stream.push(message);
+          }
+          if (! wantsMore) {
+            return;
+          }
+        }
+        this.#watch(LowLevelPosixMq.POLL_READABLE, (status) => {
+          if (status < 0) {
+            stream.destroy(new Error(`error: unable to poll message queue: error code: ${errnoName(status)}`));
+            return;
+          }
+          pull(stream.readableHighWaterMark);
+        });
+        watching = true;
+      }
+      catch (error) {
+        stream.destroy(error as Error);
+      }
+    };
+    const stream: Readable = new Readable({
+      objectMode: true,
+      highWaterMark,
+      read: pull,
+      destroy: (error, callback) => {
+        stopWatching();
+        this.#reading = false;
+        this.off('close', onClose);
+        callback(error);
+      }
+    });
+    this.#reading = true;
+    this.once('close', onClose);
+    return stream;
+  }
+
+  // Each chunk written is sent as one message, with writes buffered by the
+  // stream sent together through sendMany(). While the queue is full the
+  // remaining messages wait for the descriptor to become writable, so
+  // write() starts returning false once highWaterMark bytes are waiting.
+  createWriteStream(options: WriteStreamOptions = {}): Writable {
+    if (this.#handle === null) {
+      throw new Error("error: can't write to a closed message queue");
+    }
+    if (this.#writing) {
+      throw new Error("error: can't stream to a message queue that already has a write stream");
+    }
+    const priority = options.priority ?? 0;
+
+    let watching = false;
+    let resume: (() => void) | null = null;
+    const stopWatching = () => {
+      if (watching) {
+        this.#watch(LowLevelPosixMq.POLL_WRITABLE, null);
+      }
+      watching = false;
+    };
+    const sendAll = (messages: MessageData[], callback: (error?: Error | null) => void) => {
+      let sent = 0;
+      resume = () => {
+        try {
+          if (this.#handle === null) {
+            throw new Error("error: can't send to a closed posix message queue.");
+          }
+          sent += this.sendMany(sent === 0 ? messages : messages.slice(sent), priority, 0);
+          if (sent < messages.length) {
+            if (! watching) {
+              this.#watch(LowLevelPosixMq.POLL_WRITABLE, (status) => {
+                if (status < 0) {
+                  stopWatching();
+                  resume = null;
+                  callback(new Error(`error: unable to poll message queue: error code: ${errnoName(status)}`));
+                  return;
+                }
+                resume?.();
+              });
+              watching = true;
+            }
+            return;
+          }
+        }
+        catch (error) {
+          stopWatching();
+          resume = null;
+          callback(error as Error);
+          return;
+        }
+        stopWatching();
+        resume = null;
+        callback();
+      };
+      resume();
+    };
+    const onClose = () => {
+      watching = false;
+      resume?.();
+    };
+
+    const stream = new Writable({
+      highWaterMark: options.highWaterMark ?? this.maxMessages * this.maxMessageSize,
+      write: (chunk: Buffer, encoding, callback) => sendAll([chunk], callback),
+      writev: (chunks, callback) => sendAll(chunks.map(({ chunk }) => chunk), callback),
+      destroy: (error, callback) => {
+        stopWatching();
+        resume = null;
+        this.#writing = false;
+        this.off('close', onClose);
+        callback(error);
+      }
+    });
+    this.#writing = true;
+    this.on('close', onClose);
+    return stream;
+  }
+
+  // A byte stream whose BYOB reads receive each message straight into the
+  // reader's view. Views smaller than the maximum message size can't be
+  // handed to mq_receive, so those messages are received into a scratch
+  // buffer and copied, with whatever doesn't fit enqueued for the next
+  // read. Default readers get chunks of maxMessageSize allocated for
+  // them. The stream closes when the queue is closed.
+  readableWebStream(): ReadableStream<Uint8Array> {
+    if (this.#handle === null) {
+      throw new Error("error: can't read from a closed message queue");
+    }
+    if (this.#listening || this.#reading) {
+      throw new Error("error: can't stream from a message queue that is already being read from");
+    }
+
+    let wake: (() => void) | null = null;
+    let scratch: Uint8Array | null = null;
+    const stopWatching = () => {
+      if (this.#onReadable !== null) {
+        this.#watch(LowLevelPosixMq.POLL_READABLE, null);
+      }
+    };
+    const release = () => {
+      stopWatching();
+      this.#reading = false;
+      this.off('close', onClose);
+    };
+    const onClose = () => wake?.();
+    const readable = () => new Promise<number>((resolve) => {
+      wake = () => resolve(0);
+      this.#watch(LowLevelPosixMq.POLL_READABLE, resolve);
+    });
+
+    this.#reading = true;
+    this.once('close', onClose);
+    return new ReadableStream({
+      type: 'bytes',
+      autoAllocateChunkSize: this.maxMessageSize,
+      pull: async (controller: ReadableByteStreamController) => {
+        try {
+          for (;;) {
+            const request = controller.byobRequest!;
+            if (this.#handle === null) {
+              release();
+              controller.close();
+              request.respond(0);
+              return;
+            }
+
+            const view = request.view!;
+            const target = new Uint8Array(view.buffer, view.byteOffset, view.byteLength);
+            if (target.length >= this.maxMessageSize) {
+              const receiveResult = this.#handle.tryReceiveInto(target, 0, this.#receivedPriority, 0);
+              if (receiveResult !== null) {
+                if (receiveResult < 0) {
+                  throw new Error(`error: unable to receive message: error code: ${errnoName(receiveResult)}`);
+                }
+                request.respond(receiveResult);
+                return;
+              }
+            }
+            else {
+              scratch ??= new Uint8Array(this.maxMessageSize);
+              const receiveResult = this.#handle.tryReceiveInto(scratch, 0, this.#receivedPriority, 0);
+              if (receiveResult !== null) {
+                if (receiveResult < 0) {
+                  throw new Error(`error: unable to receive message: error code: ${errnoName(receiveResult)}`);
+                }
+                const message = scratch.subarray(0, receiveResult);
+                const copied = Math.min(target.length, message.length);
+                target.set(message.subarray(0, copied));
+                request.respond(copied);
+                if (copied < message.length) {
+                  controller.enqueue(new Uint8Array(message.subarray(copied)));
+                }
+                return;
+              }
+            }
+
+            const status = await readable();
+            wake = null;
+            stopWatching();
+            if (status < 0) {
+              throw new Error(`error: unable to poll message queue: error code: ${errnoName(status)}`);
+            }
+          }
+        }
+        catch (error) {
+          release();
+          throw error;
+        }
+      },
+      cancel: release
+    });
+  }
+
+  get attributes(): MqAttributes {
+    if (this.#handle === null) {
       throw new Error("error: can't get attributes of a closed posix message queue.");
     }
     
-    const messageQueueAttributesResult = LowLevelPosixMq.posixMqAttributes(this.mqDescriptor);
-    if (typeof messageQueueAttributesResult === 'string') {
-      throw new Error(`error: can't get message queue attributes: error code: ${messageQueueAttributesResult}`);
+    const messageQueueAttributesResult = this.#handle.attributes();
+    if (typeof messageQueueAttributesResult === 'number') {
+      throw new Error(`error: can't get message queue attributes: error code: ${errnoName(messageQueueAttributesResult)}`);
     }
     else {
       return messageQueueAttributesResult;
     }
   }
   
+  readAttributesInto(out: BigInt64Array, offset: number = 0): BigInt64Array {
+    if (this.#handle === null) {
+      throw new Error("error: can't get attributes of a closed posix message queue.");
+    }
+
+    const messageQueueAttributesResult = this.#handle.readAttributesInto(out, offset);
+    if (typeof messageQueueAttributesResult === 'number') {
+      throw new Error(`error: can't get message queue attributes: error code: ${errnoName(messageQueueAttributesResult)}`);
+    }
+    return out;
+  }
+
+  depth(): number {
+    if (this.#handle === null) {
+      throw new Error("error: can't get attributes of a closed posix message queue.");
+    }
+
+    const messageQueueDepthResult = this.#handle.depth();
+    if (messageQueueDepthResult < 0) {
+      throw new Error(`error: can't get message queue attributes: error code: ${errnoName(messageQueueDepthResult)}`);
+    }
+    return messageQueueDepthResult;
+  }
+  
   get blockingIo(): boolean {
     return ! (this.flags === fileConstants.O_NONBLOCK);
   }
   
   close(): void {
-    if (this.mqDescriptor === null) {
+    if (this.#handle === null) {
       throw new Error("error: can't close an already closed posix message queue.");
     }
+    this.unlisten();
 
-    const messageQueueCloseResult = LowLevelPosixMq.closePosixMq(this.mqDescriptor);
-    if (typeof messageQueueCloseResult === "string") {
-      throw new Error(`error: unable to close message queue: error code: ${messageQueueCloseResult}`)
+    const messageQueueCloseResult = this.#handle.close();
+    if (typeof messageQueueCloseResult === 'number') {
+      throw new Error(`error: unable to close message queue: error code: ${errnoName(messageQueueCloseResult)}`)
     }
     else {
+      this.#handle = null;
       this.mqDescriptor = null;
+      this.#onReadable = this.#onWritable = null;
+      this.emit('close');
     }
   }
   
-  send(message: Buffer, priority: number = 0, timeout?: number): boolean {
-    if (this.mqDescriptor === null) {
+  send(message: MessageData, priority: number = 0, timeout?: Timeout): boolean {
+    if (this.#handle === null) {
       throw new Error("error: can't send to a closed posix message queue.");
     }
 
-    let timespecTimeout
-    if (timeout) {
-      timespecTimeout = makeTimespec(timeout);
-    }
-    const messageQueueSendResult = LowLevelPosixMq.sendPosixMq(
-      this.mqDescriptor, message, priority, timespecTimeout
+    const messageQueueSendResult = this.#handle.send(
+      message, priority, timeout
     );
 
-    if (typeof messageQueueSendResult === 'string') {
-      if (messageQueueSendResult === "EAGAIN" && this.blockingIo) {
+    if (typeof messageQueueSendResult === 'number') {
+      if (messageQueueSendResult === -EAGAIN || messageQueueSendResult === -ETIMEDOUT) {
         return false;
       }
-      if (messageQueueSendResult === "EMSGSIZE") {
+      if (messageQueueSendResult === -EMSGSIZE) {
         const maxMessageSize = this.maxMessageSize;
         throw new Error(
           "error: can't send a message larger than the max size for this message queue: " +
-          `message size: ${message.length}: max size ${maxMessageSize}`);
+          `message size: ${message.byteLength}: max size ${maxMessageSize}`);
       }
-      throw new Error(`error: unable to send message: error code: ${messageQueueSendResult}`);
+      throw new Error(`error: unable to send message: error code: ${errnoName(messageQueueSendResult)}`);
     }
     return true;
   }
+
+  // Never blocks, even on a blocking queue: a full queue returns false
+  trySend(message: MessageData, priority: number = 0): boolean {
+    if (this.#handle === null) {
+      throw new Error("error: can't send to a closed posix message queue.");
+    }
+
+    const messageQueueSendResult = this.#handle.trySend(message, priority);
+    if (typeof messageQueueSendResult === 'boolean') {
+      return messageQueueSendResult;
+    }
+    if (messageQueueSendResult === -EMSGSIZE) {
+      throw new Error(
+        "error: can't send a message larger than the max size for this message queue: " +
+        `message size: ${message.byteLength}: max size ${this.maxMessageSize}`);
+    }
+    throw new Error(`error: unable to send message: error code: ${errnoName(messageQueueSendResult)}`);
+  }
   
-  receive(timeout?: number): Buffer | undefined {
-    if (this.mqDescriptor === null) {
+  sendMany(messages: MessageData[], priorities?: PriorityArray | number, timeout?: Timeout): number {
+    if (this.#handle === null) {
+      throw new Error("error: can't send to a closed posix message queue.");
+    }
+
+    const messageQueueSendResult = this.#handle.sendMany(
+      messages, priorities, timeout
+    );
+
+    // Failing part way through gives back how many were sent with the error
+    const [sentCount, errorCode] = typeof messageQueueSendResult === 'number'
+      ? (messageQueueSendResult < 0 ? [0, messageQueueSendResult] : [messageQueueSendResult, 0])
+      : messageQueueSendResult;
+    if (errorCode < 0) {
+      if (errorCode === -EAGAIN || errorCode === -ETIMEDOUT) {
+        return 0;
+      }
+      if (errorCode === -EMSGSIZE) {
+        // Sizes are checked before anything is sent
+        const oversized = messages.find((message) => message.byteLength > this.maxMessageSize);
+        throw new Error(
+          "error: can't send a message larger than the max size for this message queue: " +
+          `message size: ${oversized?.byteLength}: max size ${this.maxMessageSize}`);
+      }
+      const sentNote = sentCount > 0 ? `: sent ${sentCount} of ${messages.length} messages` : "";
+      throw new Error(`error: unable to send messages: error code: ${errnoName(errorCode)}${sentNote}`);
+    }
+    return sentCount;
+  }
+  
+  sendv(parts: MessageData[], priority: number = 0, timeout?: Timeout): boolean {
+    if (this.#handle === null) {
+      throw new Error("error: can't send to a closed posix message queue.");
+    }
+
+    const messageQueueSendResult = this.#handle.sendv(
+      parts, priority, timeout
+    );
+
+    if (typeof messageQueueSendResult === 'number') {
+      if (messageQueueSendResult === -EAGAIN || messageQueueSendResult === -ETIMEDOUT) {
+        return false;
+      }
+      if (messageQueueSendResult === -EMSGSIZE) {
+        const messageSize = parts.reduce((size, part) => size + part.byteLength, 0);
+        throw new Error(
+          "error: can't send a message larger than the max size for this message queue: " +
+          `message size: ${messageSize}: max size ${this.maxMessageSize}`);
+      }
+      throw new Error(`error: unable to send message: error code: ${errnoName(messageQueueSendResult)}`);
+    }
+    return true;
+  }
+  
+  // Encodes straight into the queue's staging buffer, skipping Buffer.from()
+  sendString(message: string, priority: number = 0, timeout?: Timeout): boolean {
+    if (this.#handle === null) {
+      throw new Error("error: can't send to a closed posix message queue.");
+    }
+
+    const messageQueueSendResult = this.#handle.sendString(
+      message, priority, timeout
+    );
+
+    if (typeof messageQueueSendResult === 'number') {
+      if (messageQueueSendResult === -EAGAIN || messageQueueSendResult === -ETIMEDOUT) {
+        return false;
+      }
+      if (messageQueueSendResult === -EMSGSIZE) {
+        throw new Error(
+          "error: can't send a message larger than the max size for this message queue: " +
+          `message size: ${Buffer.byteLength(message)}: max size ${this.maxMessageSize}`);
+      }
+      throw new Error(`error: unable to send message: error code: ${errnoName(messageQueueSendResult)}`);
+    }
+    return true;
+  }
+
+  receive(
+    timeout?: Timeout,
+    priorities: PriorityArray = this.#receivedPriority,
+    priorityIndex: number = 0
+  ): Buffer | undefined {
+    if (this.#handle === null) {
       throw new Error("error: can't receive from a closed posix message queue");
     }
     
-    let timespecTimeout;
-    if (timeout) {
-      timespecTimeout = makeTimespec(timeout);
-    }
-    const messageQueueReceiveResult = LowLevelPosixMq.receivePosixMq(
-      this.mqDescriptor, this.maxMessageSize, timespecTimeout
+    const messageQueueReceiveResult = this.#handle.receive(
+      priorities, priorityIndex, timeout
     );
-    if (typeof messageQueueReceiveResult === 'string') {
-      if (messageQueueReceiveResult === "EAGAIN" && this.blockingIo) {
+    if (typeof messageQueueReceiveResult === 'number') {
+      if (messageQueueReceiveResult === -EAGAIN || messageQueueReceiveResult === -ETIMEDOUT) {
         return undefined;
       }
       else {
-        throw new Error(`error: unable to receive message: error code: ${messageQueueReceiveResult}`);
+        throw new Error(`error: unable to receive message: error code: ${errnoName(messageQueueReceiveResult)}`);
       }
     }
     else {
       return messageQueueReceiveResult;
     }
   }
+
+  // Never blocks, even on a blocking queue: an empty queue returns null
+  tryReceive(
+    priorities: PriorityArray = this.#receivedPriority,
+    priorityIndex: number = 0
+  ): Buffer | null {
+    if (this.#handle === null) {
+      throw new Error("error: can't receive from a closed posix message queue");
+    }
+
+    const messageQueueReceiveResult = this.#handle.receive(priorities, priorityIndex, 0);
+    if (typeof messageQueueReceiveResult === 'number') {
+      if (messageQueueReceiveResult === -EAGAIN || messageQueueReceiveResult === -ETIMEDOUT) {
+        return null;
+      }
+      throw new Error(`error: unable to receive message: error code: ${errnoName(messageQueueReceiveResult)}`);
+    }
+    return messageQueueReceiveResult;
+  }
   
+  // Decodes the message as UTF-8 without an intermediate Buffer
+  receiveString(
+    timeout?: Timeout,
+    priorities: PriorityArray = this.#receivedPriority,
+    priorityIndex: number = 0
+  ): string | undefined {
+    if (this.#handle === null) {
+      throw new Error("error: can't receive from a closed posix message queue");
+    }
+
+    const messageQueueReceiveResult = this.#handle.receiveString(
+      priorities, priorityIndex, timeout
+    );
+    if (typeof messageQueueReceiveResult === 'number') {
+      if (messageQueueReceiveResult === -EAGAIN || messageQueueReceiveResult === -ETIMEDOUT) {
+        return undefined;
+      }
+      throw new Error(`error: unable to receive message: error code: ${errnoName(messageQueueReceiveResult)}`);
+    }
+    return messageQueueReceiveResult;
+  }
+  
+  receiveMany(maxMessages: number, timeout?: Timeout, priorities?: PriorityArray): Buffer[] {
+    if (this.#handle === null) {
+      throw new Error("error: can't receive from a closed posix message queue");
+    }
+
+    const messageQueueReceiveResult = this.#handle.receiveMany(
+      maxMessages, priorities, timeout
+    );
+    if (typeof messageQueueReceiveResult === 'number') {
+      if (messageQueueReceiveResult === -EAGAIN || messageQueueReceiveResult === -ETIMEDOUT) {
+        return [];
+      }
+      throw new Error(`error: unable to receive messages: error code: ${errnoName(messageQueueReceiveResult)}`);
+    }
+    return messageQueueReceiveResult;
+  }
+
+  receiveBatch(
+    batch: MessageBatch = new MessageBatch(this.maxMessages, this.maxMessageSize),
+    timeout?: Timeout
+  ): MessageBatch {
+    if (this.#handle === null) {
+      throw new Error("error: can't receive from a closed posix message queue");
+    }
+
+    const messageQueueReceiveResult = this.#handle.receiveBatch(
+      batch.bytes,
+      batch.offsets,
+      batch.lengths,
+      batch.priorities,
+      timeout
+    );
+    if (messageQueueReceiveResult < 0) {
+      if (messageQueueReceiveResult === -EAGAIN || messageQueueReceiveResult === -ETIMEDOUT) {
+        batch.count = 0;
+        return batch;
+      }
+      throw new Error(`error: unable to receive messages: error code: ${errnoName(messageQueueReceiveResult)}`);
+    }
+    batch.count = messageQueueReceiveResult;
+    return batch;
+  }
+
+  receiveInto(
+    target: Uint8Array,
+    offset: number = 0,
+    timeout?: Timeout,
+    priorities: PriorityArray = this.#receivedPriority,
+    priorityIndex: number = 0
+  ): number | undefined {
+    if (this.#handle === null) {
+      throw new Error("error: can't receive from a closed posix message queue");
+    }
+
+    const messageQueueReceiveResult = this.#handle.receiveInto(
+      target, offset, priorities, priorityIndex, timeout
+    );
+    if (messageQueueReceiveResult < 0) {
+      if (messageQueueReceiveResult === -EAGAIN || messageQueueReceiveResult === -ETIMEDOUT) {
+        return undefined;
+      }
+      if (messageQueueReceiveResult === -EMSGSIZE) {
+        throw new Error(
+          "error: can't receive into a buffer smaller than the max size for this message queue: " +
+          `available space: ${target.length - offset}: max size ${this.maxMessageSize}`);
+      }
+      throw new Error(`error: unable to receive message: error code: ${errnoName(messageQueueReceiveResult)}`);
+    }
+    return messageQueueReceiveResult;
+  }
+
+  get lastPriority(): number {
+    return this.#receivedPriority[0];
+  }
+
+  async sendAsync(message: MessageData, priority: number = 0, timeout?: Timeout): Promise<boolean> {
+    if (this.#handle === null) {
+      throw new Error("error: can't send to a closed posix message queue.");
+    }
+
+    const messageQueueSendResult = await this.#handle.sendAsync(
+      message, priority, timeout
+    );
+
+    if (typeof messageQueueSendResult === 'number') {
+      if (messageQueueSendResult === -EAGAIN || messageQueueSendResult === -ETIMEDOUT) {
+        return false;
+      }
+      if (messageQueueSendResult === -EMSGSIZE) {
+        throw new Error(
+          "error: can't send a message larger than the max size for this message queue: " +
+          `message size: ${message.byteLength}: max size ${this.maxMessageSize}`);
+      }
+      if (messageQueueSendResult === -EBADF) {
+        throw new Error("error: the message queue was closed before the message could be sent");
+      }
+      throw new Error(`error: unable to send message: error code: ${errnoName(messageQueueSendResult)}`);
+    }
+    return true;
+  }
+
+  async receiveAsync(
+    timeout?: Timeout,
+    priorities: PriorityArray = this.#receivedPriority,
+    priorityIndex: number = 0
+  ): Promise<Buffer | undefined> {
+    if (this.#handle === null) {
+      throw new Error("error: can't receive from a closed posix message queue");
+    }
+
+    const messageQueueReceiveResult = await this.#handle.receiveAsync(
+      priorities, priorityIndex, timeout
+    );
+    if (typeof messageQueueReceiveResult === 'number') {
+      if (messageQueueReceiveResult === -EAGAIN || messageQueueReceiveResult === -ETIMEDOUT) {
+        return undefined;
+      }
+      if (messageQueueReceiveResult === -EBADF) {
+        throw new Error("error: the message queue was closed before a message was received");
+      }
+      throw new Error(`error: unable to receive message: error code: ${errnoName(messageQueueReceiveResult)}`);
+    }
+    return messageQueueReceiveResult;
+  }
+  
+  // Reads the attributes of every descriptor in one native call, laid out
+  // as in readAttributesInto(). A queue that could not be read has a
+  // negative errno in its flags slot and zeroes elsewhere.
+  static statsMany(
+    descriptors: Int32Array,
+    out: BigInt64Array = new BigInt64Array(descriptors.length * MQ_ATTRIBUTE_FIELDS)
+  ): BigInt64Array {
+    LowLevelPosixMq.statsMany(descriptors, out);
+    return out;
+  }
+
+  // receiveAsync()/sendAsync() block on the module's own threads rather
+  // than libuv's pool. Defaults to POSMQ_THREADPOOL_SIZE, or 4.
+  static setIoThreads(threadCount: number): void {
+    if (! Number.isInteger(threadCount) || threadCount < 1) {
+      throw new Error("error: the I/O thread count must be a positive integer");
+    }
+    LowLevelPosixMq.setIoThreads(threadCount);
+  }
+
+  static allocatorStats(): AllocatorStats {
+    return LowLevelPosixMq.allocatorStats();
+  }
+
   static unlink(mqName: string, force?: boolean): void {
     const messageQueueUnlinkResult = LowLevelPosixMq.posixMqUnlink(mqName);
     
-    if (typeof messageQueueUnlinkResult === 'string') {
-      switch (messageQueueUnlinkResult) {
+    if (typeof messageQueueUnlinkResult === 'number') {
+      switch (errnoName(messageQueueUnlinkResult)) {
         case "EACCES":
           throw new Error(`error: not authorized to unlink message queue with name ${mqName}`);
           break;
@@ -321,7 +1253,7 @@ export class PosixMq extends EventEmitter {
           break;
         default:
           throw new Error(
-            `error: unable to unlink message queue: error code: ${messageQueueUnlinkResult}`
+            `error: unable to unlink message queue: error code: ${errnoName(messageQueueUnlinkResult)}`
           )
       }
     }
@@ -0,0 +1,140 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include "chunk_pool.h"
+
+// Power of two size classes from 64 B up to the 16 MiB kernel limit on
+// mq_msgsize. Chunks are carved out of slabs and recycled through a free
+// list per class; slabs are only returned to the system once the pool has
+// been released and every chunk handed out has come back. Until then the
+// pool stays at its peak size: chunks from one slab end up spread across
+// the free list, so an idle slab can't be picked out cheaply.
+#define POOL_MIN_CHUNK_SHIFT 6
+#define POOL_SIZE_CLASSES 19
+#define POOL_SLAB_SIZE (256 * 1024)
+#define POOL_ALIGNMENT 64
+
+typedef struct pool_chunk {
+  struct pool_chunk *next;
+} pool_chunk;
+
+typedef struct pool_slab {
+  struct pool_slab *next;
+} pool_slab;
+
+struct pool_size_class {
+  chunk_pool *pool;
+  size_t chunk_size;
+  pool_chunk *free_list;
+};
+
+struct chunk_pool {
+  pool_size_class size_classes[POOL_SIZE_CLASSES];
+  pool_slab *slabs;
+  chunk_pool_stats stats;
+  bool released;
+};
+
+chunk_pool *chunk_pool_create(void) {
+  chunk_pool *pool = calloc(1, sizeof(chunk_pool));
+  if (pool == NULL) {
+    return NULL;
+  }
+  for (int i = 0; i < POOL_SIZE_CLASSES; i++) {
+    pool->size_classes[i].pool = pool;
+    pool->size_classes[i].chunk_size = (size_t) 1 << (POOL_MIN_CHUNK_SHIFT + i);
+  }
+  return pool;
+}
+
+pool_size_class *chunk_pool_size_class(chunk_pool *pool, size_t size) {
+  for (int i = 0; i < POOL_SIZE_CLASSES; i++) {
+    if (pool->size_classes[i].chunk_size >= size) {
+      return &pool->size_classes[i];
+    }
+  }
+  return NULL;
+}
+
+static bool add_slab(pool_size_class *size_class) {
+  size_t chunk_count = POOL_SLAB_SIZE / size_class->chunk_size;
+  if (chunk_count == 0) {
+    chunk_count = 1;
+  }
+
+  // The slab header takes up one alignment unit so chunks stay aligned
+  void *memory;
+  if (posix_memalign(&memory, POOL_ALIGNMENT, POOL_ALIGNMENT + chunk_count * size_class->chunk_size)) {
+    return false;
+  }
+  chunk_pool *pool = size_class->pool;
+  pool_slab *slab = memory;
+  slab->next = pool->slabs;
+  pool->slabs = slab;
+  pool->stats.slab_bytes += POOL_ALIGNMENT + chunk_count * size_class->chunk_size;
+  pool->stats.chunk_count += chunk_count;
+
+  char *chunks = (char *) memory + POOL_ALIGNMENT;
+  for (size_t i = 0; i < chunk_count; i++) {
+    pool_chunk *chunk = (pool_chunk *) (chunks + i * size_class->chunk_size);
+    chunk->next = size_class->free_list;
+    size_class->free_list = chunk;
+  }
+  return true;
+}
+
+void *chunk_pool_take(pool_size_class *size_class) {
+  if (size_class->free_list == NULL && ! add_slab(size_class)) {
+    return NULL;
+  }
+  pool_chunk *chunk = size_class->free_list;
+  size_class->free_list = chunk->next;
+
+  chunk_pool_stats *stats = &size_class->pool->stats;
+  stats->chunks_in_use++;
+  stats->bytes_in_use += size_class->chunk_size;
+  if (stats->chunks_in_use > stats->peak_chunks_in_use)
+    stats->peak_chunks_in_use = stats->chunks_in_use;
+  if (stats->bytes_in_use > stats->peak_bytes_in_use)
+    stats->peak_bytes_in_use = stats->bytes_in_use;
+  return chunk;
+}
+
+static void destroy_pool(chunk_pool *pool) {
+  pool_slab *slab = pool->slabs;
+  while (slab != NULL) {
+    pool_slab *next = slab->next;
+    free(slab);
+    slab = next;
+  }
+  free(pool);
+}
+
+void chunk_pool_put(pool_size_class *size_class, void *chunk) {
+  pool_chunk *returned = chunk;
+  returned->next = size_class->free_list;
+  size_class->free_list = returned;
+
+  chunk_pool *pool = size_class->pool;
+  pool->stats.chunks_in_use--;
+  pool->stats.bytes_in_use -= size_class->chunk_size;
+  if (pool->released && pool->stats.chunks_in_use == 0) {
+    destroy_pool(pool);
+  }
+}
+
+// Buffers can outlive the module instance, so the pool stays alive until
+// the last outstanding chunk is put back
+void chunk_pool_release(chunk_pool *pool) {
+  pool->released = true;
+  if (pool->stats.chunks_in_use == 0) {
+    destroy_pool(pool);
+  }
+}
+
+size_t chunk_pool_chunk_size(const pool_size_class *size_class) {
+  return size_class->chunk_size;
+}
+
+void chunk_pool_get_stats(const chunk_pool *pool, chunk_pool_stats *stats) {
+  *stats = pool->stats;
+}
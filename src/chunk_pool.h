@@ -0,0 +1,26 @@
+#ifndef CHUNK_POOL_H
+#define CHUNK_POOL_H
+
+#include <stddef.h>
+
+typedef struct chunk_pool chunk_pool;
+typedef struct pool_size_class pool_size_class;
+
+typedef struct {
+  size_t slab_bytes;
+  size_t chunk_count;
+  size_t chunks_in_use;
+  size_t peak_chunks_in_use;
+  size_t bytes_in_use;
+  size_t peak_bytes_in_use;
+} chunk_pool_stats;
+
+chunk_pool *chunk_pool_create(void);
+pool_size_class *chunk_pool_size_class(chunk_pool *pool, size_t size);
+void *chunk_pool_take(pool_size_class *size_class);
+void chunk_pool_put(pool_size_class *size_class, void *chunk);
+void chunk_pool_release(chunk_pool *pool);
+size_t chunk_pool_chunk_size(const pool_size_class *size_class);
+void chunk_pool_get_stats(const chunk_pool *pool, chunk_pool_stats *stats);
+
+#endif /* CHUNK_POOL_H */
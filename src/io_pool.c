@@ -0,0 +1,150 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include "io_pool.h"
+
+// Threads are started on demand up to the configured count and stay
+// around afterwards, waiting for more jobs. Blocking queue operations can
+// hold a thread for as long as their timeout allows, which is why they
+// get their own threads rather than libuv's shared pool.
+#define IO_THREAD_STACK_SIZE (256 * 1024)
+
+struct io_pool {
+  pthread_mutex_t lock;
+  pthread_cond_t jobs_available;
+  io_job *head;
+  io_job *tail;
+  unsigned int queued_jobs;
+  unsigned int target_threads;
+  unsigned int threads;
+  unsigned int idle_threads;
+  bool released;
+};
+
+io_pool *io_pool_create(unsigned int thread_count) {
+  io_pool *pool = calloc(1, sizeof(io_pool));
+  if (pool == NULL) {
+    return NULL;
+  }
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->jobs_available, NULL);
+  pool->target_threads = thread_count > 0 ? thread_count : 1;
+  return pool;
+}
+
+static void destroy_pool(io_pool *pool) {
+  pthread_cond_destroy(&pool->jobs_available);
+  pthread_mutex_destroy(&pool->lock);
+  free(pool);
+}
+
+static void *run_io_thread(void *data) {
+  io_pool *pool = data;
+  pthread_mutex_lock(&pool->lock);
+  for (;;) {
+    while (pool->head == NULL && ! pool->released && pool->threads <= pool->target_threads) {
+      pool->idle_threads++;
+      pthread_cond_wait(&pool->jobs_available, &pool->lock);
+      pool->idle_threads--;
+    }
+    if (pool->released || pool->threads > pool->target_threads) {
+      break;
+    }
+
+    io_job *job = pool->head;
+    pool->head = job->next;
+    if (pool->head == NULL) {
+      pool->tail = NULL;
+    }
+    pool->queued_jobs--;
+    pthread_mutex_unlock(&pool->lock);
+    job->execute(job);
+    job->complete(job);
+    pthread_mutex_lock(&pool->lock);
+  }
+
+  pool->threads--;
+  bool destroy = pool->released && pool->threads == 0;
+  pthread_mutex_unlock(&pool->lock);
+  if (destroy) {
+    destroy_pool(pool);
+  }
+  return NULL;
+}
+
+static int start_thread(io_pool *pool) {
+  pthread_attr_t attributes;
+  pthread_attr_init(&attributes);
+  pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
+  pthread_attr_setstacksize(&attributes, IO_THREAD_STACK_SIZE);
+  pthread_t thread;
+  int error = pthread_create(&thread, &attributes, run_io_thread, pool);
+  pthread_attr_destroy(&attributes);
+  if (error == 0) {
+    pool->threads++;
+  }
+  return error;
+}
+
+// Called with the lock held. Idle threads that were already signalled
+// still count as idle until they take a job, so a thread is only started
+// when there are more queued jobs than threads waiting for them.
+static int start_threads(io_pool *pool) {
+  int error = 0;
+  unsigned int starting = 0;
+  while (pool->queued_jobs > pool->idle_threads + starting && pool->threads < pool->target_threads) {
+    error = start_thread(pool);
+    if (error != 0) {
+      break;
+    }
+    starting++;
+  }
+  return error;
+}
+
+int io_pool_submit(io_pool *pool, io_job *job) {
+  job->next = NULL;
+  pthread_mutex_lock(&pool->lock);
+  if (pool->tail == NULL) {
+    pool->head = job;
+  }
+  else {
+    pool->tail->next = job;
+  }
+  pool->tail = job;
+  pool->queued_jobs++;
+
+  int error = start_threads(pool);
+  // Busy threads will still get to the job eventually
+  if (error != 0 && pool->threads == 0) {
+    pool->head = pool->tail = NULL;
+    pool->queued_jobs = 0;
+    pthread_mutex_unlock(&pool->lock);
+    return error;
+  }
+  pthread_cond_signal(&pool->jobs_available);
+  pthread_mutex_unlock(&pool->lock);
+  return 0;
+}
+
+// Extra threads exit once they finish their current job
+void io_pool_resize(io_pool *pool, unsigned int thread_count) {
+  pthread_mutex_lock(&pool->lock);
+  pool->target_threads = thread_count > 0 ? thread_count : 1;
+  start_threads(pool);
+  pthread_cond_broadcast(&pool->jobs_available);
+  pthread_mutex_unlock(&pool->lock);
+}
+
+// Jobs still queued are dropped. Threads blocked in a job cannot be
+// interrupted, so the last one out frees the pool.
+void io_pool_release(io_pool *pool) {
+  pthread_mutex_lock(&pool->lock);
+  pool->released = true;
+  bool destroy = pool->threads == 0;
+  pthread_cond_broadcast(&pool->jobs_available);
+  pthread_mutex_unlock(&pool->lock);
+  if (destroy) {
+    destroy_pool(pool);
+  }
+}
@@ -0,0 +1,19 @@
+#ifndef IO_POOL_H
+#define IO_POOL_H
+
+typedef struct io_pool io_pool;
+
+// Embedded as the first member of a caller's job struct. execute and
+// complete both run on a pool thread, one after the other.
+typedef struct io_job {
+  struct io_job *next;
+  void (*execute)(struct io_job *job);
+  void (*complete)(struct io_job *job);
+} io_job;
+
+io_pool *io_pool_create(unsigned int thread_count);
+int io_pool_submit(io_pool *pool, io_job *job);
+void io_pool_resize(io_pool *pool, unsigned int thread_count);
+void io_pool_release(io_pool *pool);
+
+#endif /* IO_POOL_H */
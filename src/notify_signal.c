@@ -0,0 +1,135 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "notify_signal.h"
+
+// Queues registered for signal notification raise a realtime signal
+// carrying their descriptor in sigev_value. The handler only forwards the
+// descriptor down a pipe; a reader thread looks up the queue it belongs to
+// and wakes that queue's uv_async_t, so one queue firing never disturbs
+// the others. signalfd would need the signal blocked in every thread,
+// which an addon cannot arrange for threads Node has already started.
+//
+// glibc's SIGRTMIN already skips the realtime signals it uses itself.
+#define NOTIFY_SIGNAL_OFFSET 2
+#define NOTIFY_READ_BATCH 64
+
+static pthread_once_t start_once = PTHREAD_ONCE_INIT;
+static int start_error;
+static int notify_pipe[2] = {-1, -1};
+
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static uv_async_t **registry;
+static size_t registry_length;
+
+int notify_signal_number(void) {
+  return SIGRTMIN + NOTIFY_SIGNAL_OFFSET;
+}
+
+static void handle_notify_signal(int signal_number, siginfo_t *info, void *context) {
+  (void) signal_number;
+  (void) context;
+  if (info->si_code != SI_MESGQ) {
+    return;
+  }
+  int saved_errno = errno;
+  int descriptor = info->si_value.sival_int;
+  // A full pipe drops the wakeup rather than blocking in a signal handler
+  ssize_t written = write(notify_pipe[1], &descriptor, sizeof(descriptor));
+  (void) written;
+  errno = saved_errno;
+}
+
+static void *read_notifications(void *data) {
+  (void) data;
+  int descriptors[NOTIFY_READ_BATCH];
+  for (;;) {
+    // Writes of a single int are atomic, so reads never split one
+    ssize_t length = read(notify_pipe[0], descriptors, sizeof(descriptors));
+    if (length == -1 && errno == EINTR) {
+      continue;
+    }
+    if (length <= 0) {
+      return NULL;
+    }
+
+    pthread_mutex_lock(&registry_lock);
+    for (size_t i = 0; i < (size_t) length / sizeof(int); i++) {
+      int descriptor = descriptors[i];
+      if (descriptor >= 0 && (size_t) descriptor < registry_length && registry[descriptor] != NULL) {
+        uv_async_send(registry[descriptor]);
+      }
+    }
+    pthread_mutex_unlock(&registry_lock);
+  }
+}
+
+static void start(void) {
+  if (pipe(notify_pipe)) {
+    start_error = errno;
+    return;
+  }
+  fcntl(notify_pipe[0], F_SETFD, FD_CLOEXEC);
+  fcntl(notify_pipe[1], F_SETFD, FD_CLOEXEC);
+  fcntl(notify_pipe[1], F_SETFL, O_NONBLOCK);
+
+  pthread_attr_t attributes;
+  pthread_attr_init(&attributes);
+  pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
+  pthread_t reader;
+  start_error = pthread_create(&reader, &attributes, read_notifications, NULL);
+  pthread_attr_destroy(&attributes);
+  if (start_error != 0) {
+    return;
+  }
+
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_sigaction = handle_notify_signal;
+  action.sa_flags = SA_SIGINFO | SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  if (sigaction(notify_signal_number(), &action, NULL)) {
+    start_error = errno;
+  }
+}
+
+// Installs the handler and starts the reader thread the first time it is
+// called; both stay for the life of the process
+int notify_signal_start(void) {
+  pthread_once(&start_once, start);
+  return start_error;
+}
+
+int notify_signal_register(int descriptor, uv_async_t *target) {
+  pthread_mutex_lock(&registry_lock);
+  if ((size_t) descriptor >= registry_length) {
+    size_t length = registry_length > 0 ? registry_length : 64;
+    while (length <= (size_t) descriptor) {
+      length *= 2;
+    }
+    uv_async_t **grown = realloc(registry, length * sizeof(uv_async_t *));
+    if (grown == NULL) {
+      pthread_mutex_unlock(&registry_lock);
+      return ENOMEM;
+    }
+    memset(grown + registry_length, 0, (length - registry_length) * sizeof(uv_async_t *));
+    registry = grown;
+    registry_length = length;
+  }
+  registry[descriptor] = target;
+  pthread_mutex_unlock(&registry_lock);
+  return 0;
+}
+
+// Once this returns the reader thread no longer touches the target
+void notify_signal_unregister(int descriptor) {
+  pthread_mutex_lock(&registry_lock);
+  if ((size_t) descriptor < registry_length) {
+    registry[descriptor] = NULL;
+  }
+  pthread_mutex_unlock(&registry_lock);
+}
@@ -0,0 +1,11 @@
+#ifndef NOTIFY_SIGNAL_H
+#define NOTIFY_SIGNAL_H
+
+#include <uv.h>
+
+int notify_signal_number(void);
+int notify_signal_start(void);
+int notify_signal_register(int descriptor, uv_async_t *target);
+void notify_signal_unregister(int descriptor);
+
+#endif /* NOTIFY_SIGNAL_H */
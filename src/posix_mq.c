@@ -11,8 +11,16 @@
 #include <errno.h>
 #include <time.h>
 #include <signal.h>
+#include <pthread.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <uv.h>
 #include "posix_mq.h"
 #include "errnoname.h"
+#include "chunk_pool.h"
+#include "io_pool.h"
+#include "notify_signal.h"
 
 #define HANDLE_ERROR(status) if (status != napi_ok) {handle_error(env); return NULL;}
 
@@ -52,54 +60,202 @@ void handle_error(napi_env env) {
   napi_throw_error(env, NULL, error_message);
 }
 
-napi_value cerror_name(napi_env env) {
-  const char *error_name = errnoname(errno);
+napi_value cerror_code(napi_env env) {
+  napi_value node_error_code;
+  napi_status status = napi_create_int32(env, -errno, &node_error_code);
+  if (status != napi_ok) {
+    handle_error(env);
+    return NULL;
+  }
+  return node_error_code;
+}
+
+napi_value errno_name(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value argv[1];
+  napi_status status = napi_get_cb_info(env, info, &argc, argv, NULL, NULL);
+  HANDLE_ERROR(status)
+
+  int32_t error_code;
+  status = napi_get_value_int32(env, argv[0], &error_code);
+  HANDLE_ERROR(status)
+
+  const char *error_name = errnoname(error_code);
+  if (error_name == NULL) {
+    error_name = "UNKNOWN";
+  }
   napi_value node_error_string;
-  napi_status status = napi_create_string_utf8(
+  status = napi_create_string_utf8(
     env, 
     error_name, 
     NAPI_AUTO_LENGTH, 
     &node_error_string
   );
-  if (status != napi_ok) {
-    handle_error(env);
-    return NULL;
-  }
+  HANDLE_ERROR(status)
   return node_error_string;
 }
 
+#define HANDLE_CLOSED(mq) if (mq->descriptor == (mqd_t) -1) {errno = EBADF; return cerror_code(env);}
+
+napi_status check_if_undefined(napi_env env, napi_value value, bool *is_undefined) {
+  napi_valuetype type;
+  napi_status status = napi_typeof(env, value, &type);
+  if (type == napi_undefined) {
+    *is_undefined = true;
+  }
+  else {
+    *is_undefined = false;
+  }
+  return status;
+}
+
+typedef struct {
+  uv_poll_t poll_handle;
+  napi_env env;
+  napi_ref callback;
+  napi_async_context async_context;
+} mq_watcher;
+
+typedef struct {
+  uv_async_t async_handle;
+  napi_env env;
+  mqd_t descriptor;
+  napi_ref callback;
+  napi_async_context async_context;
+} mq_notifier;
+
+typedef struct mq_thread_notifier {
+  struct mq_thread_notifier *next;
+  pthread_mutex_t lock;
+  bool stopped;
+  // Set while a batch is on its way to JS. Nothing more is received until
+  // JS has taken it, so a stalled event loop leaves messages in the queue
+  // and producers see it fill up.
+  bool batch_pending;
+  uint32_t users;
+  mqd_t descriptor;
+  size_t message_size;
+  uint32_t max_batch;
+  char *scratch;
+  napi_threadsafe_function batches;
+} mq_thread_notifier;
+
+typedef struct {
+  mqd_t descriptor;
+  struct mq_attr attributes;
+  pool_size_class *receive_chunks;
+  char *send_buffer;
+  mq_watcher *watcher;
+  mq_notifier *notifier;
+  mq_thread_notifier *thread_notifier;
+  // Async operations still queued or running. close() wakes them through
+  // cancel_fd and leaves the descriptor in closed_descriptor until the
+  // last one is done, so its number can't be reused under them.
+  uint32_t operations;
+  int cancel_fd;
+  mqd_t closed_descriptor;
+} posix_mq;
+
+typedef struct {
+  napi_ref posix_mq_constructor;
+  chunk_pool *receive_pool;
+  io_pool *io_pool;
+  napi_threadsafe_function io_completions;
+  uint32_t pending_operations;
+} module_state;
+
+napi_status get_posix_mq(
+  napi_env env,
+  napi_callback_info info,
+  size_t *argc,
+  napi_value *argv,
+  posix_mq **mq
+) {
+  napi_value this;
+  napi_status status = napi_get_cb_info(env, info, argc, argv, &this, NULL);
+  if (status != napi_ok)
+    return status;
+  return napi_unwrap(env, this, (void **) mq);
+}
+
+void stop_watcher(napi_env env, posix_mq *mq);
+void stop_notifier(napi_env env, posix_mq *mq);
+void stop_thread_notifier(posix_mq *mq, bool release);
+
+void close_cancel_fd(posix_mq *mq) {
+  if (mq->cancel_fd != -1) {
+    close(mq->cancel_fd);
+    mq->cancel_fd = -1;
+  }
+}
+
+// Operations blocked on the queue wake up and fail with EBADF
+void cancel_operations(posix_mq *mq) {
+  uint64_t increment = 1;
+  ssize_t written = write(mq->cancel_fd, &increment, sizeof(increment));
+  (void) written;
+}
+
+void free_posix_mq(napi_env env, void *data, void *hint) {
+  (void) hint;
+  posix_mq *mq = data;
+  if (mq->watcher != NULL) {
+    stop_watcher(env, mq);
+  }
+  if (mq->notifier != NULL) {
+    stop_notifier(env, mq);
+  }
+  // The threadsafe function may already be gone if the environment is
+  // being torn down, and otherwise keeps the queue reachable, so it is
+  // not released here
+  if (mq->thread_notifier != NULL) {
+    stop_thread_notifier(mq, false);
+  }
+  // Operations hold a reference to the queue, so this only happens while
+  // the environment is torn down. Their threads may still be using the
+  // descriptors, which are left open rather than closed under them.
+  if (mq->operations > 0) {
+    cancel_operations(mq);
+  }
+  else {
+    if (mq->descriptor != (mqd_t) -1) {
+      mq_close(mq->descriptor);
+    }
+    close_cancel_fd(mq);
+  }
+  free(mq->send_buffer);
+  free(mq);
+}
+
 napi_value get_message_queue_attributes(napi_env env, napi_callback_info info) {
-  size_t argc = 1;
-  napi_value function_argv[1];
-  napi_status status = napi_get_cb_info(env, info, &argc, function_argv, NULL, NULL);
+  size_t argc = 0;
+  posix_mq *mq;
+  napi_status status = get_posix_mq(env, info, &argc, NULL, &mq);
   HANDLE_ERROR(status)
-  
+  HANDLE_CLOSED(mq)
+
   struct mq_attr mq_attributes;
-  int32_t mq_descriptor;
-  
-  status = napi_get_value_int32(env, function_argv[0], &mq_descriptor);
-  HANDLE_ERROR(status)
-  
-  if (mq_getattr(mq_descriptor, &mq_attributes)) {
-    return cerror_name(env);
+
+  if (mq_getattr(mq->descriptor, &mq_attributes)) {
+    return cerror_code(env);
   }
 
   napi_value message_queue_flags;
   status = napi_create_int64(env, mq_attributes.mq_flags, &message_queue_flags);
   HANDLE_ERROR(status)
-  
+
   napi_value message_queue_max_messages;
   status = napi_create_int64(env, mq_attributes.mq_maxmsg, &message_queue_max_messages);
   HANDLE_ERROR(status)
-  
+
   napi_value message_queue_max_message_size;
   status = napi_create_int64(env, mq_attributes.mq_msgsize, &message_queue_max_message_size);
   HANDLE_ERROR(status)
-  
+
   napi_value message_queue_current_message_count;
   status = napi_create_int64(env, mq_attributes.mq_curmsgs, &message_queue_current_message_count);
   HANDLE_ERROR(status)
-  
+
   napi_value node_mq_attributes_object;
   status = napi_create_object(env, &node_mq_attributes_object);
   HANDLE_ERROR(status)
@@ -111,20 +267,190 @@ napi_value get_message_queue_attributes(napi_env env, napi_callback_info info) {
   HANDLE_ERROR(status)
   status = napi_set_named_property(env, node_mq_attributes_object, "currentMessageCount", message_queue_current_message_count);
   HANDLE_ERROR(status)
-    
+
   return node_mq_attributes_object;
 }
 
-napi_status check_if_undefined(napi_env env, napi_value value, bool *is_undefined) {
-  napi_valuetype type;
-  napi_status status = napi_typeof(env, value, &type);
-  if (type == napi_undefined) {
-    *is_undefined = true;
+napi_status get_typedarray_data(
+  napi_env env,
+  napi_value typedarray,
+  napi_typedarray_type expected_type,
+  void **data,
+  size_t *length
+) {
+  napi_typedarray_type type;
+  napi_status status = napi_get_typedarray_info(
+    env, typedarray, &type, length, data, NULL, NULL
+  );
+  if (status != napi_ok)
+    return status;
+  if (type != expected_type) {
+    napi_throw_type_error(env, NULL, "typed array has the wrong element type");
+    return napi_pending_exception;
   }
-  else {
-    *is_undefined = false;
+  return napi_ok;
+}
+
+// Accepts any ArrayBuffer or ArrayBufferView and points at its bytes in place
+napi_status get_bytes(napi_env env, napi_value value, char **data, size_t *length) {
+  bool is_type;
+  napi_status status = napi_is_typedarray(env, value, &is_type);
+  if (status != napi_ok)
+    return status;
+  if (is_type) {
+    napi_typedarray_type type;
+    size_t element_count;
+    status = napi_get_typedarray_info(
+      env, value, &type, &element_count, (void **) data, NULL, NULL
+    );
+    if (status != napi_ok)
+      return status;
+    static const size_t element_sizes[] = {
+      [napi_int8_array] = 1,
+      [napi_uint8_array] = 1,
+      [napi_uint8_clamped_array] = 1,
+      [napi_int16_array] = 2,
+      [napi_uint16_array] = 2,
+      [napi_int32_array] = 4,
+      [napi_uint32_array] = 4,
+      [napi_float32_array] = 4,
+      [napi_float64_array] = 8,
+      [napi_bigint64_array] = 8,
+      [napi_biguint64_array] = 8
+    };
+    if ((size_t) type >= sizeof(element_sizes) / sizeof(element_sizes[0])) {
+      napi_throw_type_error(env, NULL, "typed array has an unsupported element type");
+      return napi_pending_exception;
+    }
+    *length = element_count * element_sizes[type];
+    return napi_ok;
   }
-  return status;
+
+  status = napi_is_dataview(env, value, &is_type);
+  if (status != napi_ok)
+    return status;
+  if (is_type) {
+    return napi_get_dataview_info(env, value, length, (void **) data, NULL, NULL);
+  }
+
+  status = napi_is_arraybuffer(env, value, &is_type);
+  if (status != napi_ok)
+    return status;
+  if (is_type) {
+    return napi_get_arraybuffer_info(env, value, (void **) data, length);
+  }
+
+  napi_throw_type_error(env, NULL, "message must be an ArrayBuffer or ArrayBufferView");
+  return napi_pending_exception;
+}
+
+#define MQ_ATTRIBUTE_FIELDS 4
+
+void write_attributes(int64_t *out, const struct mq_attr *mq_attributes) {
+  out[0] = mq_attributes->mq_flags;
+  out[1] = mq_attributes->mq_maxmsg;
+  out[2] = mq_attributes->mq_msgsize;
+  out[3] = mq_attributes->mq_curmsgs;
+}
+
+napi_value read_attributes_into_posix_mq(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value argv[2];
+  posix_mq *mq;
+  napi_status status = get_posix_mq(env, info, &argc, argv, &mq);
+  HANDLE_ERROR(status)
+  HANDLE_CLOSED(mq)
+
+  int64_t *out;
+  size_t out_length;
+  status = get_typedarray_data(env, argv[0], napi_bigint64_array, (void **) &out, &out_length);
+  if (status == napi_pending_exception)
+    return NULL;
+  HANDLE_ERROR(status)
+
+  uint32_t offset;
+  status = napi_get_value_uint32(env, argv[1], &offset);
+  HANDLE_ERROR(status)
+  if (out_length < MQ_ATTRIBUTE_FIELDS || offset > out_length - MQ_ATTRIBUTE_FIELDS) {
+    napi_throw_range_error(env, NULL, "attributes do not fit in the target array");
+    return NULL;
+  }
+
+  struct mq_attr mq_attributes;
+  if (mq_getattr(mq->descriptor, &mq_attributes)) {
+    return cerror_code(env);
+  }
+  write_attributes(out + offset, &mq_attributes);
+  return NULL;
+}
+
+// A failed lookup stores -errno in the flags slot, which is never negative
+napi_value stats_many_posix_mq(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value argv[2];
+  napi_status status = napi_get_cb_info(env, info, &argc, argv, NULL, NULL);
+  HANDLE_ERROR(status)
+
+  int32_t *descriptors;
+  size_t descriptor_count;
+  status = get_typedarray_data(env, argv[0], napi_int32_array, (void **) &descriptors, &descriptor_count);
+  if (status == napi_pending_exception)
+    return NULL;
+  HANDLE_ERROR(status)
+
+  int64_t *out;
+  size_t out_length;
+  status = get_typedarray_data(env, argv[1], napi_bigint64_array, (void **) &out, &out_length);
+  if (status == napi_pending_exception)
+    return NULL;
+  HANDLE_ERROR(status)
+  if (out_length / MQ_ATTRIBUTE_FIELDS < descriptor_count) {
+    napi_throw_range_error(env, NULL, "attributes do not fit in the target array");
+    return NULL;
+  }
+
+  uint32_t succeeded = 0;
+  for (size_t i = 0; i < descriptor_count; i++) {
+    int64_t *slot = out + i * MQ_ATTRIBUTE_FIELDS;
+    struct mq_attr mq_attributes;
+    if (mq_getattr((mqd_t) descriptors[i], &mq_attributes)) {
+      slot[0] = -errno;
+      slot[1] = slot[2] = slot[3] = 0;
+      continue;
+    }
+    write_attributes(slot, &mq_attributes);
+    succeeded++;
+  }
+
+  napi_value node_succeeded;
+  status = napi_create_uint32(env, succeeded, &node_succeeded);
+  HANDLE_ERROR(status)
+  return node_succeeded;
+}
+
+napi_value depth_posix_mq(napi_env env, napi_callback_info info) {
+  size_t argc = 0;
+  posix_mq *mq;
+  napi_status status = get_posix_mq(env, info, &argc, NULL, &mq);
+  HANDLE_ERROR(status)
+  HANDLE_CLOSED(mq)
+
+  struct mq_attr mq_attributes;
+  if (mq_getattr(mq->descriptor, &mq_attributes)) {
+    return cerror_code(env);
+  }
+
+  napi_value node_depth;
+  status = napi_create_int64(env, mq_attributes.mq_curmsgs, &node_depth);
+  HANDLE_ERROR(status)
+  return node_depth;
+}
+
+napi_value posix_mq_constructor(napi_env env, napi_callback_info info) {
+  napi_value this;
+  napi_status status = napi_get_cb_info(env, info, NULL, NULL, &this, NULL);
+  HANDLE_ERROR(status)
+  return this;
 }
 
 napi_value open_posix_mq(napi_env env, napi_callback_info info) {
@@ -142,10 +468,10 @@ napi_value open_posix_mq(napi_env env, napi_callback_info info) {
   status = napi_get_value_int32(env, function_argv[1], &oflag);
   HANDLE_ERROR(status)
 
-  uint32_t max_msgs; 
+  uint32_t max_msgs;
   status = napi_get_value_uint32(env, function_argv[2], &max_msgs);
   HANDLE_ERROR(status)
-  
+
   uint32_t max_msg_size;
   status = napi_get_value_uint32(env, function_argv[3], &max_msg_size);
   HANDLE_ERROR(status)
@@ -154,210 +480,1900 @@ napi_value open_posix_mq(napi_env env, napi_callback_info info) {
     .mq_maxmsg = max_msgs,
     .mq_msgsize = max_msg_size
   };
-  int32_t mq = mq_open(
+  int32_t descriptor = mq_open(
       c_name,
-      oflag, 
-      S_IRWXU, 
+      oflag,
+      S_IRWXU,
       &attributes
   );
   free(c_name);
-  
-  if (mq == (mqd_t) -1) {
-    return cerror_name(env);
+
+  if (descriptor == (mqd_t) -1) {
+    return cerror_code(env);
   }
-  
-  napi_value message_descriptor;
-  status = napi_create_int32(env, mq, &message_descriptor);
+
+  posix_mq *mq = calloc(1, sizeof(posix_mq));
+  mq->descriptor = descriptor;
+  mq->cancel_fd = -1;
+  mq->closed_descriptor = (mqd_t) -1;
+  if (mq_getattr(descriptor, &mq->attributes)) {
+    int error = errno;
+    free_posix_mq(env, mq, NULL);
+    errno = error;
+    return cerror_code(env);
+  }
+
+  module_state *state;
+  status = napi_get_instance_data(env, (void **) &state);
+  if (status != napi_ok) {
+    free_posix_mq(env, mq, NULL);
+    handle_error(env);
+    return NULL;
+  }
+
+  mq->receive_chunks = chunk_pool_size_class(state->receive_pool, mq->attributes.mq_msgsize);
+  // One spare byte for the terminator napi_get_value_string_utf8 writes
+  mq->send_buffer = malloc(mq->attributes.mq_msgsize + 1);
+  if (mq->receive_chunks == NULL || mq->send_buffer == NULL) {
+    free_posix_mq(env, mq, NULL);
+    errno = ENOMEM;
+    return cerror_code(env);
+  }
+
+  napi_value constructor;
+  napi_value node_mq;
+  status = napi_get_reference_value(env, state->posix_mq_constructor, &constructor);
+  if (status == napi_ok)
+    status = napi_new_instance(env, constructor, 0, NULL, &node_mq);
+  if (status == napi_ok)
+    status = napi_wrap(env, node_mq, mq, free_posix_mq, NULL, NULL);
+  if (status != napi_ok) {
+    free_posix_mq(env, mq, NULL);
+    handle_error(env);
+    return NULL;
+  }
+
+  napi_value node_descriptor;
+  status = napi_create_int32(env, descriptor, &node_descriptor);
+  HANDLE_ERROR(status)
+  napi_value node_flags;
+  status = napi_create_int64(env, mq->attributes.mq_flags, &node_flags);
+  HANDLE_ERROR(status)
+  napi_value node_max_messages;
+  status = napi_create_int64(env, mq->attributes.mq_maxmsg, &node_max_messages);
+  HANDLE_ERROR(status)
+  napi_value node_max_message_size;
+  status = napi_create_int64(env, mq->attributes.mq_msgsize, &node_max_message_size);
+  HANDLE_ERROR(status)
+
+  napi_property_descriptor properties[] = {
+    {"descriptor", NULL, NULL, NULL, NULL, node_descriptor, napi_enumerable, NULL},
+    {"flags", NULL, NULL, NULL, NULL, node_flags, napi_enumerable, NULL},
+    {"maxMessages", NULL, NULL, NULL, NULL, node_max_messages, napi_enumerable, NULL},
+    {"maxMessageSize", NULL, NULL, NULL, NULL, node_max_message_size, napi_enumerable, NULL}
+  };
+  status = napi_define_properties(
+    env, node_mq, sizeof(properties) / sizeof(properties[0]), properties
+  );
   HANDLE_ERROR(status)
-  return message_descriptor;
+  return node_mq;
 }
 
 napi_value close_posix_mq(napi_env env, napi_callback_info info) {
-  size_t argc = 1;
-  napi_value argv[1];
-  napi_status status = napi_get_cb_info(env, info, &argc, argv, NULL, NULL);
+  size_t argc = 0;
+  posix_mq *mq;
+  napi_status status = get_posix_mq(env, info, &argc, NULL, &mq);
   HANDLE_ERROR(status)
+  HANDLE_CLOSED(mq)
 
-  int32_t message_descriptor;
-  status = napi_get_value_int32(env, argv[0], &message_descriptor);
-  if (mq_close(message_descriptor)) {
-    return cerror_name(env);
+  if (mq->watcher != NULL) {
+    stop_watcher(env, mq);
+  }
+  if (mq->notifier != NULL) {
+    stop_notifier(env, mq);
+  }
+  if (mq->thread_notifier != NULL) {
+    stop_thread_notifier(mq, true);
+  }
+  if (mq->operations > 0) {
+    cancel_operations(mq);
+    mq->closed_descriptor = mq->descriptor;
+    mq->descriptor = (mqd_t) -1;
+    return NULL;
+  }
+  if (mq_close(mq->descriptor)) {
+    return cerror_code(env);
   }
+  mq->descriptor = (mqd_t) -1;
+  close_cancel_fd(mq);
   return NULL;
 }
 
-napi_status get_timespec(napi_env env, napi_value timespec_object, struct timespec *time) {
-    napi_value seconds;
-    napi_status status = napi_get_named_property(
-      env, timespec_object, "seconds", &seconds
-    );
-    if (status != napi_ok)
-      return status;
+napi_status get_deadline(
+  napi_env env,
+  napi_value timeout,
+  bool *has_deadline,
+  struct timespec *deadline
+) {
+  napi_valuetype type;
+  napi_status status = napi_typeof(env, timeout, &type);
+  if (status != napi_ok)
+    return status;
 
-    napi_value nanoseconds;
-    status = napi_get_named_property(
-      env, timespec_object, "nanoseconds", &nanoseconds
-    );
-    if (status != napi_ok)
-      return status;
+  *has_deadline = type != napi_undefined;
+  if (! *has_deadline)
+    return napi_ok;
 
-    int64_t seconds_value;
-    status = napi_get_value_int64(env, seconds, &seconds_value);
+  int64_t timeout_nanoseconds;
+  if (type == napi_bigint) {
+    bool lossless;
+    status = napi_get_value_bigint_int64(env, timeout, &timeout_nanoseconds, &lossless);
     if (status != napi_ok)
       return status;
-    
-    int64_t nanoseconds_value;
-    status = napi_get_value_int64(env, nanoseconds, &nanoseconds_value);
+    if (! lossless) {
+      // Out of range either way, so only the sign matters
+      int sign_bit;
+      uint64_t word;
+      size_t word_count = 0;
+      status = napi_get_value_bigint_words(env, timeout, &sign_bit, &word_count, &word);
+      if (status != napi_ok)
+        return status;
+      timeout_nanoseconds = sign_bit ? 0 : INT64_MAX;
+    }
+  }
+  else {
+    double timeout_milliseconds;
+    status = napi_get_value_double(env, timeout, &timeout_milliseconds);
     if (status != napi_ok)
       return status;
-      
-    time->tv_sec = seconds_value;
-    time->tv_nsec = nanoseconds_value;
-    
-    return napi_ok;
+    // Also catches NaN, which would be undefined to convert
+    if (! (timeout_milliseconds > 0))
+      timeout_nanoseconds = 0;
+    else if (timeout_milliseconds * 1E6 >= (double) INT64_MAX)
+      timeout_nanoseconds = INT64_MAX;
+    else
+      timeout_nanoseconds = timeout_milliseconds * 1E6;
+  }
+  if (timeout_nanoseconds < 0)
+    timeout_nanoseconds = 0;
+
+  clock_gettime(CLOCK_REALTIME, deadline);
+  deadline->tv_sec += timeout_nanoseconds / 1000000000;
+  deadline->tv_nsec += timeout_nanoseconds % 1000000000;
+  if (deadline->tv_nsec >= 1000000000) {
+    deadline->tv_sec++;
+    deadline->tv_nsec -= 1000000000;
+  }
+  return napi_ok;
+}
+
+// An expired deadline makes a timed call non-blocking whatever O_NONBLOCK says
+static const struct timespec already_expired = {0, 0};
+
+// Without a deadline this blocks for as long as O_NONBLOCK allows
+ssize_t receive_until(
+  mqd_t descriptor,
+  char *data,
+  size_t length,
+  unsigned int *priority,
+  const struct timespec *deadline
+) {
+  if (deadline != NULL)
+    return mq_timedreceive(descriptor, data, length, priority, deadline);
+  return mq_receive(descriptor, data, length, priority);
 }
 
 napi_value send_posix_mq(napi_env env, napi_callback_info info) {
-  size_t argc = 4;
-  napi_value argv[4];
-  napi_status status = napi_get_cb_info(env, info, &argc, argv, NULL, NULL);
+  size_t argc = 3;
+  napi_value argv[3];
+  posix_mq *mq;
+  napi_status status = get_posix_mq(env, info, &argc, argv, &mq);
   HANDLE_ERROR(status)
+  HANDLE_CLOSED(mq)
 
-  napi_value undefined;
-  napi_get_undefined(env, &undefined);
-  
-  napi_value message_queue_object = argv[0];
-  int32_t message_descriptor; 
-  status = napi_get_value_int32(env, message_queue_object, &message_descriptor);
-
-  
-  napi_value message = argv[1];
+  napi_value message = argv[0];
   char *message_data;
   size_t message_length;
-  status = napi_get_buffer_info(
-    env, message, (void **)&message_data, &message_length
-  );
+  status = get_bytes(env, message, &message_data, &message_length);
+  if (status == napi_pending_exception)
+    return NULL;
   HANDLE_ERROR(status)
 
   uint32_t message_priority;
-  status = napi_get_value_uint32(env, argv[2], &message_priority);
+  status = napi_get_value_uint32(env, argv[1], &message_priority);
   HANDLE_ERROR(status)
-    
-  napi_value absolute_timeout = argv[3];
-  
-  bool timeout_is_undefined;
-  check_if_undefined(env, absolute_timeout, &timeout_is_undefined);
+
+  bool has_timeout;
+  struct timespec c_timeout;
+  status = get_deadline(env, argv[2], &has_timeout, &c_timeout);
   HANDLE_ERROR(status)
 
-  if (! timeout_is_undefined) {
-    struct timespec c_timeout;
-    status = get_timespec(env, absolute_timeout, &c_timeout);
-    HANDLE_ERROR(status)
-      
+  if (has_timeout) {
     if (mq_timedsend(
-      message_descriptor, 
-      message_data, 
-      message_length, 
-      message_priority, 
+      mq->descriptor,
+      message_data,
+      message_length,
+      message_priority,
       &c_timeout)) {
-      return cerror_name(env);
+      return cerror_code(env);
     }
     return NULL;
   }
-  
+
 
   if (mq_send(
-    message_descriptor,
-    message_data, 
-    message_length, 
+    mq->descriptor,
+    message_data,
+    message_length,
     message_priority
   )) {
-    return cerror_name(env);
+    return cerror_code(env);
   }
   return NULL;
 }
 
-napi_value receive_posix_mq(napi_env env, napi_callback_info info) {
-  size_t argc = 3;
-  napi_value argv[3];
-  napi_status status = napi_get_cb_info(env, info, &argc, argv, NULL, NULL);
-  HANDLE_ERROR(status)
-
-  napi_value undefined;
-  napi_get_undefined(env, &undefined);
-  
-  int32_t mq;
-  status = napi_get_value_int32(env, argv[0], &mq);
+napi_value try_send_posix_mq(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value argv[2];
+  posix_mq *mq;
+  napi_status status = get_posix_mq(env, info, &argc, argv, &mq);
   HANDLE_ERROR(status)
+  HANDLE_CLOSED(mq)
 
-  uint32_t message_length;
-  status = napi_get_value_uint32(env, argv[1], &message_length);
-  HANDLE_ERROR(status)
-    
   char *message_data;
-  unsigned int priority;
-
-  napi_value absolute_timeout = argv[2];
-  bool timeout_is_undefined;
-  check_if_undefined(env, absolute_timeout, &timeout_is_undefined);
+  size_t message_length;
+  status = get_bytes(env, argv[0], &message_data, &message_length);
+  if (status == napi_pending_exception)
+    return NULL;
   HANDLE_ERROR(status)
 
-  if (! timeout_is_undefined) {
-    struct timespec timeout;
-    status = get_timespec(env, absolute_timeout, &timeout);
-    HANDLE_ERROR(status)
-      
-    message_data =  malloc(sizeof(char) * message_length);
-
-    if (mq_timedreceive(
-      mq, 
-      message_data, 
-      message_length, 
-      &priority, 
-      &timeout)) {
-        free(message_data);
-        return cerror_name(env);
-      }
-  }
-    
-  else {
-    message_data =  malloc(sizeof(char) * message_length);
+  uint32_t message_priority;
+  status = napi_get_value_uint32(env, argv[1], &message_priority);
+  HANDLE_ERROR(status)
 
-    if (mq_receive(mq, message_data, message_length, &priority) == -1) {
-      free(message_data);
-      return cerror_name(env);
+  bool sent = true;
+  if (mq_timedsend(
+    mq->descriptor,
+    message_data,
+    message_length,
+    message_priority,
+    &already_expired)) {
+    if (errno != EAGAIN && errno != ETIMEDOUT) {
+      return cerror_code(env);
     }
+    sent = false;
   }
-  
-  napi_value node_data;
-  status = napi_create_buffer_copy(env, message_length, message_data, NULL, &node_data);
-  free(message_data);
+
+  napi_value node_sent;
+  status = napi_get_boolean(env, sent, &node_sent);
   HANDLE_ERROR(status)
-  return node_data;
+  return node_sent;
 }
 
-napi_value notify_posix_mq(napi_env env, napi_callback_info info) {
-  size_t argc = 1;
-  napi_value argv[1];
-  napi_status status = napi_get_cb_info(env, info, &argc, argv, NULL, NULL);
-  HANDLE_ERROR(status)
-    
-  int32_t mq;
-  status = napi_get_value_int32(env, argv[0], &mq);
-  HANDLE_ERROR(status)
-    
-  struct sigevent notify_event = {
-    .sigev_notify = SIGEV_SIGNAL,
-    .sigev_signo = SIGUSR2
-  };
-  
-  if (mq_notify(mq, &notify_event)) {
-    return cerror_name(env);
-  }
-  else {
-    return NULL;
-  }
-  
+// Chunks held by Buffers are reported to V8 so it can weigh them when
+// deciding to collect, since the pool memory is invisible to it otherwise
+void return_pooled_chunk(napi_env env, void *data, void *hint) {
+  int64_t adjusted_value;
+  napi_adjust_external_memory(env, -(int64_t) chunk_pool_chunk_size(hint), &adjusted_value);
+  chunk_pool_put(hint, data);
+}
+
+// Takes ownership of the chunk whether or not the buffer is created
+napi_status create_pooled_buffer(
+  napi_env env,
+  pool_size_class *size_class,
+  char *chunk,
+  size_t length,
+  napi_value *result
+) {
+  napi_status status = napi_create_external_buffer(
+    env, length, chunk, return_pooled_chunk, size_class, result
+  );
+  if (status == napi_ok) {
+    int64_t adjusted_value;
+    return napi_adjust_external_memory(
+      env, chunk_pool_chunk_size(size_class), &adjusted_value
+    );
+  }
+  // Runtimes built with the V8 sandbox refuse to wrap external memory
+  if (status == napi_no_external_buffers_allowed)
+    status = napi_create_buffer_copy(env, length, chunk, NULL, result);
+  chunk_pool_put(size_class, chunk);
+  return status;
+}
+
+napi_status get_priority_slot(
+  napi_env env,
+  napi_value priorities,
+  napi_value node_index,
+  uint32_t **slot
+) {
+  napi_typedarray_type type;
+  size_t length;
+  void *data;
+  napi_status status = napi_get_typedarray_info(
+    env, priorities, &type, &length, &data, NULL, NULL
+  );
+  if (status != napi_ok)
+    return status;
+  if (type != napi_uint32_array && type != napi_int32_array) {
+    napi_throw_type_error(env, NULL, "priorities must be an Int32Array or a Uint32Array");
+    return napi_pending_exception;
+  }
+
+  uint32_t index;
+  status = napi_get_value_uint32(env, node_index, &index);
+  if (status != napi_ok)
+    return status;
+  if (index >= length) {
+    napi_throw_range_error(env, NULL, "priority index is outside of the priorities array");
+    return napi_pending_exception;
+  }
+
+  *slot = (uint32_t *) data + index;
+  return napi_ok;
+}
+
+napi_value receive_posix_mq(napi_env env, napi_callback_info info) {
+  size_t argc = 3;
+  napi_value argv[3];
+  posix_mq *mq;
+  napi_status status = get_posix_mq(env, info, &argc, argv, &mq);
+  HANDLE_ERROR(status)
+  HANDLE_CLOSED(mq)
+
+  uint32_t *priority_slot;
+  status = get_priority_slot(env, argv[0], argv[1], &priority_slot);
+  if (status == napi_pending_exception)
+    return NULL;
+  HANDLE_ERROR(status)
+
+  bool has_timeout;
+  struct timespec timeout;
+  status = get_deadline(env, argv[2], &has_timeout, &timeout);
+  HANDLE_ERROR(status)
+
+  char *message_data = chunk_pool_take(mq->receive_chunks);
+  if (message_data == NULL) {
+    errno = ENOMEM;
+    return cerror_code(env);
+  }
+  unsigned int priority;
+  ssize_t received_length = receive_until(
+    mq->descriptor, message_data, mq->attributes.mq_msgsize, &priority, has_timeout ? &timeout : NULL
+  );
+
+  if (received_length == -1) {
+    chunk_pool_put(mq->receive_chunks, message_data);
+    return cerror_code(env);
+  }
+  *priority_slot = priority;
+
+  napi_value node_data;
+  status = create_pooled_buffer(env, mq->receive_chunks, message_data, received_length, &node_data);
+  HANDLE_ERROR(status)
+  return node_data;
+}
+
+napi_value receive_into_posix_mq(napi_env env, napi_callback_info info) {
+  size_t argc = 5;
+  napi_value argv[5];
+  posix_mq *mq;
+  napi_status status = get_posix_mq(env, info, &argc, argv, &mq);
+  HANDLE_ERROR(status)
+  HANDLE_CLOSED(mq)
+
+  char *target_data;
+  size_t target_length;
+  status = get_typedarray_data(
+    env, argv[0], napi_uint8_array, (void **) &target_data, &target_length
+  );
+  if (status == napi_pending_exception)
+    return NULL;
+  HANDLE_ERROR(status)
+
+  uint32_t offset;
+  status = napi_get_value_uint32(env, argv[1], &offset);
+  HANDLE_ERROR(status)
+  if (offset > target_length) {
+    napi_throw_range_error(env, NULL, "offset is outside of the target buffer");
+    return NULL;
+  }
+
+  uint32_t *priority_slot;
+  status = get_priority_slot(env, argv[2], argv[3], &priority_slot);
+  if (status == napi_pending_exception)
+    return NULL;
+  HANDLE_ERROR(status)
+
+  bool has_timeout;
+  struct timespec timeout;
+  status = get_deadline(env, argv[4], &has_timeout, &timeout);
+  HANDLE_ERROR(status)
+
+  unsigned int priority;
+  ssize_t received_length = receive_until(
+    mq->descriptor, target_data + offset, target_length - offset, &priority, has_timeout ? &timeout : NULL
+  );
+
+  if (received_length == -1) {
+    return cerror_code(env);
+  }
+  *priority_slot = priority;
+
+  napi_value node_received_length;
+  status = napi_create_int64(env, received_length, &node_received_length);
+  HANDLE_ERROR(status)
+  return node_received_length;
+}
+
+napi_value receive_string_posix_mq(napi_env env, napi_callback_info info) {
+  size_t argc = 3;
+  napi_value argv[3];
+  posix_mq *mq;
+  napi_status status = get_posix_mq(env, info, &argc, argv, &mq);
+  HANDLE_ERROR(status)
+  HANDLE_CLOSED(mq)
+
+  uint32_t *priority_slot;
+  status = get_priority_slot(env, argv[0], argv[1], &priority_slot);
+  if (status == napi_pending_exception)
+    return NULL;
+  HANDLE_ERROR(status)
+
+  bool has_timeout;
+  struct timespec timeout;
+  status = get_deadline(env, argv[2], &has_timeout, &timeout);
+  HANDLE_ERROR(status)
+
+  // The message only lives here until it is decoded, so borrow a chunk
+  char *message_data = chunk_pool_take(mq->receive_chunks);
+  if (message_data == NULL) {
+    errno = ENOMEM;
+    return cerror_code(env);
+  }
+  unsigned int priority;
+  ssize_t received_length = receive_until(
+    mq->descriptor, message_data, mq->attributes.mq_msgsize, &priority, has_timeout ? &timeout : NULL
+  );
+
+  if (received_length == -1) {
+    chunk_pool_put(mq->receive_chunks, message_data);
+    return cerror_code(env);
+  }
+  *priority_slot = priority;
+
+  napi_value node_string;
+  status = napi_create_string_utf8(env, message_data, received_length, &node_string);
+  chunk_pool_put(mq->receive_chunks, message_data);
+  HANDLE_ERROR(status)
+  return node_string;
+}
+
+napi_value try_receive_into_posix_mq(napi_env env, napi_callback_info info) {
+  size_t argc = 4;
+  napi_value argv[4];
+  posix_mq *mq;
+  napi_status status = get_posix_mq(env, info, &argc, argv, &mq);
+  HANDLE_ERROR(status)
+  HANDLE_CLOSED(mq)
+
+  char *target_data;
+  size_t target_length;
+  status = get_typedarray_data(
+    env, argv[0], napi_uint8_array, (void **) &target_data, &target_length
+  );
+  if (status == napi_pending_exception)
+    return NULL;
+  HANDLE_ERROR(status)
+
+  uint32_t offset;
+  status = napi_get_value_uint32(env, argv[1], &offset);
+  HANDLE_ERROR(status)
+  if (offset > target_length) {
+    napi_throw_range_error(env, NULL, "offset is outside of the target buffer");
+    return NULL;
+  }
+
+  uint32_t *priority_slot;
+  status = get_priority_slot(env, argv[2], argv[3], &priority_slot);
+  if (status == napi_pending_exception)
+    return NULL;
+  HANDLE_ERROR(status)
+
+  unsigned int priority;
+  ssize_t received_length = receive_until(
+    mq->descriptor, target_data + offset, target_length - offset, &priority, &already_expired
+  );
+
+  napi_value result;
+  if (received_length == -1) {
+    if (errno != EAGAIN && errno != ETIMEDOUT) {
+      return cerror_code(env);
+    }
+    status = napi_get_null(env, &result);
+    HANDLE_ERROR(status)
+    return result;
+  }
+  *priority_slot = priority;
+
+  status = napi_create_int64(env, received_length, &result);
+  HANDLE_ERROR(status)
+  return result;
+}
+
+napi_value receive_many_posix_mq(napi_env env, napi_callback_info info) {
+  size_t argc = 3;
+  napi_value argv[3];
+  posix_mq *mq;
+  napi_status status = get_posix_mq(env, info, &argc, argv, &mq);
+  HANDLE_ERROR(status)
+  HANDLE_CLOSED(mq)
+
+  uint32_t max_messages;
+  status = napi_get_value_uint32(env, argv[0], &max_messages);
+  HANDLE_ERROR(status)
+
+  uint32_t *priorities = NULL;
+  bool priorities_is_undefined;
+  status = check_if_undefined(env, argv[1], &priorities_is_undefined);
+  HANDLE_ERROR(status)
+  if (! priorities_is_undefined && max_messages > 0) {
+    napi_value last_index;
+    status = napi_create_uint32(env, max_messages - 1, &last_index);
+    HANDLE_ERROR(status)
+    status = get_priority_slot(env, argv[1], last_index, &priorities);
+    if (status == napi_pending_exception)
+      return NULL;
+    HANDLE_ERROR(status)
+    priorities -= max_messages - 1;
+  }
+
+  bool has_timeout;
+  struct timespec timeout;
+  status = get_deadline(env, argv[2], &has_timeout, &timeout);
+  HANDLE_ERROR(status)
+
+  size_t message_length = mq->attributes.mq_msgsize;
+
+  napi_value messages;
+  status = napi_create_array(env, &messages);
+  HANDLE_ERROR(status)
+
+  const struct timespec *deadline = has_timeout ? &timeout : NULL;
+  uint32_t received_count = 0;
+  while (received_count < max_messages) {
+    char *message_data = chunk_pool_take(mq->receive_chunks);
+    if (message_data == NULL) {
+      if (received_count == 0) {
+        errno = ENOMEM;
+        return cerror_code(env);
+      }
+      break;
+    }
+    // Only the first message is waited for
+    unsigned int priority;
+    ssize_t received_length = receive_until(
+      mq->descriptor, message_data, message_length, &priority, deadline
+    );
+    deadline = &already_expired;
+
+    if (received_length == -1) {
+      chunk_pool_put(mq->receive_chunks, message_data);
+      if (received_count == 0) {
+        return cerror_code(env);
+      }
+      break;
+    }
+
+    napi_value node_data;
+    status = create_pooled_buffer(env, mq->receive_chunks, message_data, received_length, &node_data);
+    HANDLE_ERROR(status)
+    status = napi_set_element(env, messages, received_count, node_data);
+    HANDLE_ERROR(status)
+    if (priorities != NULL) {
+      priorities[received_count] = priority;
+    }
+    received_count++;
+  }
+
+  return messages;
+}
+
+napi_value receive_batch_posix_mq(napi_env env, napi_callback_info info) {
+  size_t argc = 5;
+  napi_value argv[5];
+  posix_mq *mq;
+  napi_status status = get_posix_mq(env, info, &argc, argv, &mq);
+  HANDLE_ERROR(status)
+  HANDLE_CLOSED(mq)
+
+  char *data;
+  size_t data_length;
+  status = get_typedarray_data(env, argv[0], napi_uint8_array, (void **) &data, &data_length);
+  if (status == napi_pending_exception)
+    return NULL;
+  HANDLE_ERROR(status)
+
+  uint32_t *offsets;
+  size_t offsets_length;
+  status = get_typedarray_data(env, argv[1], napi_uint32_array, (void **) &offsets, &offsets_length);
+  if (status == napi_pending_exception)
+    return NULL;
+  HANDLE_ERROR(status)
+
+  uint32_t *lengths;
+  size_t lengths_length;
+  status = get_typedarray_data(env, argv[2], napi_uint32_array, (void **) &lengths, &lengths_length);
+  if (status == napi_pending_exception)
+    return NULL;
+  HANDLE_ERROR(status)
+
+  uint16_t *priorities;
+  size_t priorities_length;
+  status = get_typedarray_data(env, argv[3], napi_uint16_array, (void **) &priorities, &priorities_length);
+  if (status == napi_pending_exception)
+    return NULL;
+  HANDLE_ERROR(status)
+
+  bool has_timeout;
+  struct timespec timeout;
+  status = get_deadline(env, argv[4], &has_timeout, &timeout);
+  HANDLE_ERROR(status)
+
+  size_t message_length = mq->attributes.mq_msgsize;
+  size_t max_messages = offsets_length;
+  if (lengths_length < max_messages)
+    max_messages = lengths_length;
+  if (priorities_length < max_messages)
+    max_messages = priorities_length;
+  // Otherwise nothing could be received and the batch would look empty
+  if (max_messages > 0 && data_length < message_length) {
+    napi_throw_range_error(env, NULL, "batch bytes are smaller than the max message size of the queue");
+    return NULL;
+  }
+
+  const struct timespec *deadline = has_timeout ? &timeout : NULL;
+  uint32_t received_count = 0;
+  size_t data_offset = 0;
+  while (received_count < max_messages && data_length - data_offset >= message_length) {
+    unsigned int priority;
+    ssize_t received_length = receive_until(
+      mq->descriptor, data + data_offset, message_length, &priority, deadline
+    );
+    deadline = &already_expired;
+
+    if (received_length == -1) {
+      if (received_count == 0) {
+        return cerror_code(env);
+      }
+      break;
+    }
+
+    offsets[received_count] = data_offset;
+    lengths[received_count] = received_length;
+    priorities[received_count] = priority;
+    data_offset += received_length;
+    received_count++;
+  }
+
+  napi_value node_received_count;
+  status = napi_create_uint32(env, received_count, &node_received_count);
+  HANDLE_ERROR(status)
+  return node_received_count;
+}
+
+typedef struct {
+  char *data;
+  size_t length;
+} send_part;
+
+napi_value send_many_posix_mq(napi_env env, napi_callback_info info) {
+  size_t argc = 3;
+  napi_value argv[3];
+  posix_mq *mq;
+  napi_status status = get_posix_mq(env, info, &argc, argv, &mq);
+  HANDLE_ERROR(status)
+  HANDLE_CLOSED(mq)
+
+  napi_value messages = argv[0];
+  uint32_t message_count;
+  status = napi_get_array_length(env, messages, &message_count);
+  HANDLE_ERROR(status)
+
+  napi_valuetype priorities_type;
+  status = napi_typeof(env, argv[1], &priorities_type);
+  HANDLE_ERROR(status)
+
+  uint32_t message_priority = 0;
+  uint32_t *priorities = NULL;
+  if (priorities_type == napi_number) {
+    status = napi_get_value_uint32(env, argv[1], &message_priority);
+    HANDLE_ERROR(status)
+  }
+  else if (priorities_type != napi_undefined && message_count > 0) {
+    napi_value last_index;
+    status = napi_create_uint32(env, message_count - 1, &last_index);
+    HANDLE_ERROR(status)
+    status = get_priority_slot(env, argv[1], last_index, &priorities);
+    if (status == napi_pending_exception)
+      return NULL;
+    HANDLE_ERROR(status)
+    priorities -= message_count - 1;
+  }
+
+  bool has_timeout;
+  struct timespec timeout;
+  status = get_deadline(env, argv[2], &has_timeout, &timeout);
+  HANDLE_ERROR(status)
+
+  // Every message is type and size checked before any is sent, so a bad one
+  // can't leave the queue holding only part of the list
+  napi_value node_sent_count;
+  if (message_count == 0) {
+    status = napi_create_uint32(env, 0, &node_sent_count);
+    HANDLE_ERROR(status)
+    return node_sent_count;
+  }
+  send_part *parts = malloc(message_count * sizeof(send_part));
+  if (parts == NULL) {
+    errno = ENOMEM;
+    return cerror_code(env);
+  }
+  for (uint32_t i = 0; i < message_count; i++) {
+    napi_value message;
+    status = napi_get_element(env, messages, i, &message);
+    if (status == napi_ok)
+      status = get_bytes(env, message, &parts[i].data, &parts[i].length);
+    if (status != napi_ok) {
+      free(parts);
+      if (status != napi_pending_exception)
+        handle_error(env);
+      return NULL;
+    }
+    if (parts[i].length > (size_t) mq->attributes.mq_msgsize) {
+      free(parts);
+      errno = EMSGSIZE;
+      return cerror_code(env);
+    }
+  }
+
+  const struct timespec *deadline = has_timeout ? &timeout : NULL;
+  uint32_t sent_count = 0;
+  int send_error = 0;
+  while (sent_count < message_count) {
+    if (priorities != NULL) {
+      message_priority = priorities[sent_count];
+    }
+
+    int send_result;
+    if (deadline != NULL) {
+      send_result = mq_timedsend(
+        mq->descriptor, parts[sent_count].data, parts[sent_count].length, message_priority, deadline
+      );
+    }
+    else {
+      send_result = mq_send(
+        mq->descriptor, parts[sent_count].data, parts[sent_count].length, message_priority
+      );
+    }
+
+    if (send_result) {
+      send_error = errno;
+      break;
+    }
+    sent_count++;
+  }
+  free(parts);
+
+  // A full queue just ends the run early. Anything else is reported, along
+  // with how many messages made it in before it happened.
+  if (send_error != 0 && (sent_count == 0 || (send_error != EAGAIN && send_error != ETIMEDOUT))) {
+    errno = send_error;
+    napi_value node_error_code = cerror_code(env);
+    if (sent_count == 0 || node_error_code == NULL)
+      return node_error_code;
+
+    napi_value partial_result;
+    status = napi_create_array_with_length(env, 2, &partial_result);
+    HANDLE_ERROR(status)
+    status = napi_create_uint32(env, sent_count, &node_sent_count);
+    HANDLE_ERROR(status)
+    status = napi_set_element(env, partial_result, 0, node_sent_count);
+    HANDLE_ERROR(status)
+    status = napi_set_element(env, partial_result, 1, node_error_code);
+    HANDLE_ERROR(status)
+    return partial_result;
+  }
+
+  status = napi_create_uint32(env, sent_count, &node_sent_count);
+  HANDLE_ERROR(status)
+  return node_sent_count;
+}
+
+napi_value sendv_posix_mq(napi_env env, napi_callback_info info) {
+  size_t argc = 3;
+  napi_value argv[3];
+  posix_mq *mq;
+  napi_status status = get_posix_mq(env, info, &argc, argv, &mq);
+  HANDLE_ERROR(status)
+  HANDLE_CLOSED(mq)
+
+  napi_value parts = argv[0];
+  uint32_t part_count;
+  status = napi_get_array_length(env, parts, &part_count);
+  HANDLE_ERROR(status)
+
+  uint32_t message_priority;
+  status = napi_get_value_uint32(env, argv[1], &message_priority);
+  HANDLE_ERROR(status)
+
+  char *message_data = mq->send_buffer;
+  size_t max_message_length = mq->attributes.mq_msgsize;
+  size_t message_length = 0;
+  for (uint32_t part_index = 0; part_index < part_count; part_index++) {
+    napi_value part;
+    status = napi_get_element(env, parts, part_index, &part);
+    HANDLE_ERROR(status)
+
+    char *part_data;
+    size_t part_length;
+    status = get_bytes(env, part, &part_data, &part_length);
+    if (status == napi_pending_exception)
+      return NULL;
+    HANDLE_ERROR(status)
+
+    if (part_length > max_message_length - message_length) {
+      errno = EMSGSIZE;
+      return cerror_code(env);
+    }
+    memcpy(message_data + message_length, part_data, part_length);
+    message_length += part_length;
+  }
+
+  bool has_timeout;
+  struct timespec timeout;
+  status = get_deadline(env, argv[2], &has_timeout, &timeout);
+  HANDLE_ERROR(status)
+
+  if (has_timeout) {
+    if (mq_timedsend(mq->descriptor, message_data, message_length, message_priority, &timeout)) {
+      return cerror_code(env);
+    }
+    return NULL;
+  }
+
+  if (mq_send(mq->descriptor, message_data, message_length, message_priority)) {
+    return cerror_code(env);
+  }
+  return NULL;
+}
+
+napi_value send_string_posix_mq(napi_env env, napi_callback_info info) {
+  size_t argc = 3;
+  napi_value argv[3];
+  posix_mq *mq;
+  napi_status status = get_posix_mq(env, info, &argc, argv, &mq);
+  HANDLE_ERROR(status)
+  HANDLE_CLOSED(mq)
+
+  char *message_data = mq->send_buffer;
+  size_t max_message_length = mq->attributes.mq_msgsize;
+  size_t message_length;
+  status = napi_get_value_string_utf8(
+    env, argv[0], message_data, max_message_length + 1, &message_length
+  );
+  HANDLE_ERROR(status)
+  // Encoding stops short of a character that does not fit, so a result
+  // this close to the limit may have been truncated
+  if (message_length + 4 > max_message_length) {
+    size_t full_length;
+    status = napi_get_value_string_utf8(env, argv[0], NULL, 0, &full_length);
+    HANDLE_ERROR(status)
+    if (full_length > max_message_length) {
+      errno = EMSGSIZE;
+      return cerror_code(env);
+    }
+  }
+
+  uint32_t message_priority;
+  status = napi_get_value_uint32(env, argv[1], &message_priority);
+  HANDLE_ERROR(status)
+
+  bool has_timeout;
+  struct timespec timeout;
+  status = get_deadline(env, argv[2], &has_timeout, &timeout);
+  HANDLE_ERROR(status)
+
+  if (has_timeout) {
+    if (mq_timedsend(mq->descriptor, message_data, message_length, message_priority, &timeout)) {
+      return cerror_code(env);
+    }
+    return NULL;
+  }
+
+  if (mq_send(mq->descriptor, message_data, message_length, message_priority)) {
+    return cerror_code(env);
+  }
+  return NULL;
+}
+
+// Blocking receives and sends run on the module's own threads so waiting
+// consumers cannot starve libuv's pool, which fs and dns rely on
+#define DEFAULT_IO_THREADS 4
+
+typedef struct {
+  io_job job;
+  napi_threadsafe_function completions;
+  napi_deferred deferred;
+  napi_ref handle_ref;
+  napi_ref message_ref;
+  napi_ref priorities_ref;
+  uint32_t priority_index;
+  posix_mq *queue;
+  // Pool threads only use these copies, never the queue itself
+  mqd_t descriptor;
+  int cancel_fd;
+  bool nonblocking;
+  char *message_data;
+  pool_size_class *message_chunks;
+  size_t message_length;
+  unsigned int priority;
+  bool has_timeout;
+  struct timespec timeout;
+  ssize_t result;
+  int error;
+} mq_async_operation;
+
+// Milliseconds left until the deadline, rounded up, or -1 without one
+int remaining_milliseconds(const mq_async_operation *operation) {
+  if (! operation->has_timeout)
+    return -1;
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  int64_t remaining = (int64_t) (operation->timeout.tv_sec - now.tv_sec) * 1000000000
+    + (operation->timeout.tv_nsec - now.tv_nsec);
+  if (remaining <= 0)
+    return 0;
+  int64_t milliseconds = (remaining + 999999) / 1000000;
+  return milliseconds > INT32_MAX ? INT32_MAX : (int) milliseconds;
+}
+
+// Operations try the queue without blocking and otherwise poll it along
+// with the cancel descriptor, rather than blocking in mq_receive or
+// mq_send, which closing the queue would not interrupt
+void run_async_operation(
+  mq_async_operation *operation,
+  short events,
+  ssize_t (*attempt)(mq_async_operation *operation)
+) {
+  struct pollfd descriptors[2] = {
+    {.fd = operation->cancel_fd, .events = POLLIN},
+    {.fd = operation->descriptor, .events = events}
+  };
+  int wait = 0;
+  for (;;) {
+    int ready = poll(descriptors, 2, wait);
+    if (ready == -1 && errno != EINTR) {
+      operation->result = -1;
+      operation->error = errno;
+      return;
+    }
+    // Checked first so operations still queued when the queue is closed
+    // never touch it
+    if (ready > 0 && descriptors[0].revents != 0) {
+      operation->result = -1;
+      operation->error = EBADF;
+      return;
+    }
+
+    if (ready > 0 || wait == 0) {
+      operation->result = attempt(operation);
+      if (operation->result != -1) {
+        return;
+      }
+      if ((errno != EAGAIN && errno != ETIMEDOUT) || operation->nonblocking) {
+        operation->error = errno;
+        return;
+      }
+    }
+
+    wait = remaining_milliseconds(operation);
+    if (wait == 0) {
+      operation->result = -1;
+      operation->error = ETIMEDOUT;
+      return;
+    }
+  }
+}
+
+ssize_t attempt_receive(mq_async_operation *operation) {
+  return receive_until(
+    operation->descriptor,
+    operation->message_data,
+    operation->message_length,
+    &operation->priority,
+    &already_expired
+  );
+}
+
+ssize_t attempt_send(mq_async_operation *operation) {
+  return mq_timedsend(
+    operation->descriptor,
+    operation->message_data,
+    operation->message_length,
+    operation->priority,
+    &already_expired
+  );
+}
+
+void execute_receive_async(io_job *job) {
+  run_async_operation((mq_async_operation *) job, POLLIN, attempt_receive);
+}
+
+void execute_send_async(io_job *job) {
+  run_async_operation((mq_async_operation *) job, POLLOUT, attempt_send);
+}
+
+// Runs on the pool thread once the operation is done
+void post_async_operation(io_job *job) {
+  mq_async_operation *operation = (mq_async_operation *) job;
+  napi_threadsafe_function completions = operation->completions;
+  // Only fails while the module is being torn down, when the result has
+  // nowhere to go anyway
+  if (napi_call_threadsafe_function(completions, operation, napi_tsfn_nonblocking) != napi_ok) {
+    free(operation);
+  }
+  napi_release_threadsafe_function(completions, napi_tsfn_release);
+}
+
+void free_async_operation(napi_env env, mq_async_operation *operation) {
+  if (operation->handle_ref != NULL) {
+    napi_delete_reference(env, operation->handle_ref);
+  }
+  if (operation->message_ref != NULL) {
+    napi_delete_reference(env, operation->message_ref);
+  }
+  else {
+    napi_delete_reference(env, operation->priorities_ref);
+    if (operation->message_data != NULL)
+      chunk_pool_put(operation->message_chunks, operation->message_data);
+  }
+  free(operation);
+}
+
+void complete_async_operation(napi_env env, mq_async_operation *operation) {
+  napi_status status = napi_ok;
+  napi_value result = NULL;
+  if (operation->result == -1) {
+    errno = operation->error;
+    result = cerror_code(env);
+  }
+  else if (operation->message_ref == NULL) {
+    status = create_pooled_buffer(
+      env, operation->message_chunks, operation->message_data, operation->result, &result
+    );
+    operation->message_data = NULL;
+    napi_value priorities;
+    napi_value priority_index;
+    uint32_t *priority_slot;
+    if (status == napi_ok)
+      status = napi_get_reference_value(env, operation->priorities_ref, &priorities);
+    if (status == napi_ok)
+      status = napi_create_uint32(env, operation->priority_index, &priority_index);
+    if (status == napi_ok)
+      status = get_priority_slot(env, priorities, priority_index, &priority_slot);
+    if (status == napi_ok)
+      *priority_slot = operation->priority;
+  }
+  else {
+    status = napi_get_null(env, &result);
+  }
+
+  if (status == napi_ok && result != NULL) {
+    napi_resolve_deferred(env, operation->deferred, result);
+  }
+  else {
+    napi_value error;
+    napi_value error_message;
+    napi_create_string_utf8(
+      env, "message queue operation failed", NAPI_AUTO_LENGTH, &error_message
+    );
+    napi_create_error(env, NULL, error_message, &error);
+    napi_reject_deferred(env, operation->deferred, error);
+  }
+
+  free_async_operation(env, operation);
+}
+
+// Called on the JS thread for each finished operation. The completions
+// function only keeps the loop alive while operations are in flight.
+void deliver_async_operation(napi_env env, napi_value callback, void *context, void *data) {
+  (void) callback;
+  mq_async_operation *operation = data;
+  if (env == NULL) {
+    free(operation);
+    return;
+  }
+  module_state *state = context;
+  if (--state->pending_operations == 0) {
+    napi_unref_threadsafe_function(env, state->io_completions);
+  }
+  posix_mq *mq = operation->queue;
+  if (--mq->operations == 0 && mq->closed_descriptor != (mqd_t) -1) {
+    mq_close(mq->closed_descriptor);
+    mq->closed_descriptor = (mqd_t) -1;
+    close_cancel_fd(mq);
+  }
+  complete_async_operation(env, operation);
+}
+
+void reject_async_operation(napi_env env, mq_async_operation *operation, const char *message) {
+  napi_value error_message;
+  napi_value node_error;
+  napi_create_string_utf8(env, message, NAPI_AUTO_LENGTH, &error_message);
+  napi_create_error(env, NULL, error_message, &node_error);
+  napi_reject_deferred(env, operation->deferred, node_error);
+  free_async_operation(env, operation);
+}
+
+// The operation holds a reference to the queue's handle until it is
+// delivered, so the queue can't be finalized under it
+napi_status queue_async_operation(
+  napi_env env,
+  napi_value handle,
+  posix_mq *mq,
+  mq_async_operation *operation,
+  void (*execute)(io_job *job),
+  napi_value *promise
+) {
+  module_state *state;
+  napi_status status = napi_get_instance_data(env, (void **) &state);
+  if (status != napi_ok)
+    return status;
+
+  status = napi_create_promise(env, &operation->deferred, promise);
+  if (status != napi_ok)
+    return status;
+
+  if (mq->cancel_fd == -1) {
+    mq->cancel_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (mq->cancel_fd == -1) {
+      reject_async_operation(env, operation, "unable to create a message queue cancellation descriptor");
+      return napi_ok;
+    }
+  }
+  status = napi_create_reference(env, handle, 1, &operation->handle_ref);
+  if (status != napi_ok) {
+    reject_async_operation(env, operation, "message queue operation failed");
+    return napi_ok;
+  }
+  operation->queue = mq;
+  operation->descriptor = mq->descriptor;
+  operation->cancel_fd = mq->cancel_fd;
+  operation->nonblocking = (mq->attributes.mq_flags & O_NONBLOCK) != 0;
+
+  operation->job.execute = execute;
+  operation->job.complete = post_async_operation;
+  operation->completions = state->io_completions;
+  napi_acquire_threadsafe_function(operation->completions);
+  if (state->pending_operations++ == 0) {
+    napi_ref_threadsafe_function(env, state->io_completions);
+  }
+
+  int error = io_pool_submit(state->io_pool, &operation->job);
+  if (error != 0) {
+    napi_release_threadsafe_function(operation->completions, napi_tsfn_release);
+    if (--state->pending_operations == 0) {
+      napi_unref_threadsafe_function(env, state->io_completions);
+    }
+    reject_async_operation(env, operation, "unable to start a message queue I/O thread");
+    return napi_ok;
+  }
+  mq->operations++;
+  return napi_ok;
+}
+
+napi_value receive_posix_mq_async(napi_env env, napi_callback_info info) {
+  size_t argc = 3;
+  napi_value argv[3];
+  posix_mq *mq;
+  napi_status status = get_posix_mq(env, info, &argc, argv, &mq);
+  HANDLE_ERROR(status)
+  HANDLE_CLOSED(mq)
+
+  uint32_t *priority_slot;
+  status = get_priority_slot(env, argv[0], argv[1], &priority_slot);
+  if (status == napi_pending_exception)
+    return NULL;
+  HANDLE_ERROR(status)
+
+  mq_async_operation *operation = calloc(1, sizeof(mq_async_operation));
+  operation->message_length = mq->attributes.mq_msgsize;
+
+  status = napi_get_value_uint32(env, argv[1], &operation->priority_index);
+  if (status == napi_ok)
+    status = get_deadline(env, argv[2], &operation->has_timeout, &operation->timeout);
+  if (status == napi_ok)
+    status = napi_create_reference(env, argv[0], 1, &operation->priorities_ref);
+  if (status != napi_ok) {
+    free(operation);
+    handle_error(env);
+    return NULL;
+  }
+
+  operation->message_chunks = mq->receive_chunks;
+  operation->message_data = chunk_pool_take(operation->message_chunks);
+  if (operation->message_data == NULL) {
+    napi_delete_reference(env, operation->priorities_ref);
+    free(operation);
+    errno = ENOMEM;
+    return cerror_code(env);
+  }
+
+  napi_value promise;
+  napi_value handle;
+  status = napi_get_cb_info(env, info, NULL, NULL, &handle, NULL);
+  if (status == napi_ok)
+    status = queue_async_operation(
+      env, handle, mq, operation, execute_receive_async, &promise
+    );
+  if (status != napi_ok) {
+    napi_delete_reference(env, operation->priorities_ref);
+    chunk_pool_put(operation->message_chunks, operation->message_data);
+    free(operation);
+    handle_error(env);
+    return NULL;
+  }
+  return promise;
+}
+
+napi_value send_posix_mq_async(napi_env env, napi_callback_info info) {
+  size_t argc = 3;
+  napi_value argv[3];
+  posix_mq *mq;
+  napi_status status = get_posix_mq(env, info, &argc, argv, &mq);
+  HANDLE_ERROR(status)
+  HANDLE_CLOSED(mq)
+
+  char *message_data;
+  size_t message_length;
+  status = get_bytes(env, argv[0], &message_data, &message_length);
+  if (status == napi_pending_exception)
+    return NULL;
+  HANDLE_ERROR(status)
+
+  uint32_t message_priority;
+  status = napi_get_value_uint32(env, argv[1], &message_priority);
+  HANDLE_ERROR(status)
+
+  mq_async_operation *operation = calloc(1, sizeof(mq_async_operation));
+  operation->message_data = message_data;
+  operation->message_length = message_length;
+  operation->priority = message_priority;
+
+  status = get_deadline(env, argv[2], &operation->has_timeout, &operation->timeout);
+  if (status == napi_ok)
+    status = napi_create_reference(env, argv[0], 1, &operation->message_ref);
+  if (status != napi_ok) {
+    free(operation);
+    handle_error(env);
+    return NULL;
+  }
+
+  napi_value promise;
+  napi_value handle;
+  status = napi_get_cb_info(env, info, NULL, NULL, &handle, NULL);
+  if (status == napi_ok)
+    status = queue_async_operation(
+      env, handle, mq, operation, execute_send_async, &promise
+    );
+  if (status != napi_ok) {
+    napi_delete_reference(env, operation->message_ref);
+    free(operation);
+    handle_error(env);
+    return NULL;
+  }
+  return promise;
+}
+
+void watcher_closed(uv_handle_t *handle) {
+  free(handle->data);
+}
+
+// Calls back into JS from a libuv callback with up to two int arguments
+void invoke_callback(
+  napi_env env,
+  napi_async_context async_context,
+  napi_ref callback_ref,
+  size_t argc,
+  const int32_t *args
+) {
+  napi_handle_scope scope;
+  if (napi_open_handle_scope(env, &scope) != napi_ok) {
+    return;
+  }
+
+  napi_value callback;
+  napi_value global;
+  napi_value argv[2];
+  napi_value result;
+  napi_status status = napi_get_reference_value(env, callback_ref, &callback);
+  if (status == napi_ok)
+    status = napi_get_global(env, &global);
+  for (size_t i = 0; i < argc && status == napi_ok; i++)
+    status = napi_create_int32(env, args[i], &argv[i]);
+  if (status == napi_ok)
+    status = napi_make_callback(
+      env, async_context, global, callback, argc, argv, &result
+    );
+
+  if (status == napi_pending_exception) {
+    napi_value exception;
+    napi_get_and_clear_last_exception(env, &exception);
+    napi_fatal_exception(env, exception);
+  }
+  napi_close_handle_scope(env, scope);
+}
+
+void watcher_poll(uv_poll_t *handle, int poll_status, int events) {
+  mq_watcher *watcher = handle->data;
+  const int32_t args[] = {poll_status, events};
+  invoke_callback(watcher->env, watcher->async_context, watcher->callback, 2, args);
+}
+
+void stop_watcher(napi_env env, posix_mq *mq) {
+  mq_watcher *watcher = mq->watcher;
+  uv_poll_stop(&watcher->poll_handle);
+  napi_delete_reference(env, watcher->callback);
+  napi_async_destroy(env, watcher->async_context);
+  uv_close((uv_handle_t *) &watcher->poll_handle, watcher_closed);
+  mq->watcher = NULL;
+}
+
+napi_value watch_posix_mq(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value argv[2];
+  posix_mq *mq;
+  napi_status status = get_posix_mq(env, info, &argc, argv, &mq);
+  HANDLE_ERROR(status)
+  HANDLE_CLOSED(mq)
+
+  int32_t events;
+  status = napi_get_value_int32(env, argv[0], &events);
+  HANDLE_ERROR(status)
+
+  if (mq->watcher != NULL) {
+    stop_watcher(env, mq);
+  }
+
+  struct uv_loop_s *loop;
+  status = napi_get_uv_event_loop(env, &loop);
+  HANDLE_ERROR(status)
+
+  mq_watcher *watcher = calloc(1, sizeof(mq_watcher));
+  watcher->env = env;
+  watcher->poll_handle.data = watcher;
+
+  // uv_poll_init makes the descriptor non-blocking for good, which would
+  // leave a blocking queue failing with EAGAIN long after the watcher stops.
+  // Everything done under a watcher uses an expired deadline anyway.
+  int descriptor_flags = fcntl(mq->descriptor, F_GETFL);
+  int uv_status = uv_poll_init(loop, &watcher->poll_handle, mq->descriptor);
+  if (descriptor_flags != -1)
+    fcntl(mq->descriptor, F_SETFL, descriptor_flags);
+  if (uv_status) {
+    free(watcher);
+    errno = -uv_status;
+    return cerror_code(env);
+  }
+
+  napi_value resource_name;
+  status = napi_create_string_utf8(env, "PosixMqWatcher", NAPI_AUTO_LENGTH, &resource_name);
+  if (status == napi_ok)
+    status = napi_async_init(env, NULL, resource_name, &watcher->async_context);
+  if (status == napi_ok)
+    status = napi_create_reference(env, argv[1], 1, &watcher->callback);
+  if (status != napi_ok) {
+    uv_close((uv_handle_t *) &watcher->poll_handle, watcher_closed);
+    handle_error(env);
+    return NULL;
+  }
+
+  mq->watcher = watcher;
+  uv_status = uv_poll_start(&watcher->poll_handle, events, watcher_poll);
+  if (uv_status) {
+    stop_watcher(env, mq);
+    errno = -uv_status;
+    return cerror_code(env);
+  }
+  return NULL;
+}
+
+napi_value unwatch_posix_mq(napi_env env, napi_callback_info info) {
+  size_t argc = 0;
+  posix_mq *mq;
+  napi_status status = get_posix_mq(env, info, &argc, NULL, &mq);
+  HANDLE_ERROR(status)
+
+  if (mq->watcher != NULL) {
+    stop_watcher(env, mq);
+  }
+  return NULL;
+}
+
+int arm_signal_notification(mqd_t descriptor) {
+  struct sigevent notify_event = {
+    .sigev_notify = SIGEV_SIGNAL,
+    .sigev_signo = notify_signal_number(),
+    .sigev_value.sival_int = descriptor
+  };
+  return mq_notify(descriptor, &notify_event) ? -errno : 0;
+}
+
+// mq_notify registrations are one-shot, so re-arm before handing over to
+// JS; anything that arrived in between is picked up by the drain
+void notifier_fired(uv_async_t *handle) {
+  mq_notifier *notifier = handle->data;
+  const int32_t args[] = {arm_signal_notification(notifier->descriptor)};
+  invoke_callback(notifier->env, notifier->async_context, notifier->callback, 1, args);
+}
+
+void notifier_closed(uv_handle_t *handle) {
+  free(handle->data);
+}
+
+void stop_notifier(napi_env env, posix_mq *mq) {
+  mq_notifier *notifier = mq->notifier;
+  notify_signal_unregister(notifier->descriptor);
+  mq_notify(notifier->descriptor, NULL);
+  napi_delete_reference(env, notifier->callback);
+  napi_async_destroy(env, notifier->async_context);
+  uv_close((uv_handle_t *) &notifier->async_handle, notifier_closed);
+  mq->notifier = NULL;
+}
+
+napi_value notify_posix_mq(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value argv[1];
+  posix_mq *mq;
+  napi_status status = get_posix_mq(env, info, &argc, argv, &mq);
+  HANDLE_ERROR(status)
+  HANDLE_CLOSED(mq)
+
+  int error = notify_signal_start();
+  if (error != 0) {
+    errno = error;
+    return cerror_code(env);
+  }
+
+  if (mq->notifier != NULL) {
+    stop_notifier(env, mq);
+  }
+
+  struct uv_loop_s *loop;
+  status = napi_get_uv_event_loop(env, &loop);
+  HANDLE_ERROR(status)
+
+  mq_notifier *notifier = calloc(1, sizeof(mq_notifier));
+  notifier->env = env;
+  notifier->descriptor = mq->descriptor;
+  notifier->async_handle.data = notifier;
+
+  int uv_status = uv_async_init(loop, &notifier->async_handle, notifier_fired);
+  if (uv_status) {
+    free(notifier);
+    errno = -uv_status;
+    return cerror_code(env);
+  }
+
+  napi_value resource_name;
+  status = napi_create_string_utf8(env, "PosixMqNotifier", NAPI_AUTO_LENGTH, &resource_name);
+  if (status == napi_ok)
+    status = napi_async_init(env, NULL, resource_name, &notifier->async_context);
+  if (status == napi_ok)
+    status = napi_create_reference(env, argv[0], 1, &notifier->callback);
+  if (status != napi_ok) {
+    uv_close((uv_handle_t *) &notifier->async_handle, notifier_closed);
+    handle_error(env);
+    return NULL;
+  }
+
+  mq->notifier = notifier;
+  error = notify_signal_register(notifier->descriptor, &notifier->async_handle);
+  if (error == 0) {
+    error = -arm_signal_notification(notifier->descriptor);
+  }
+  if (error != 0) {
+    stop_notifier(env, mq);
+    errno = error;
+    return cerror_code(env);
+  }
+  return NULL;
+}
+
+// SIGEV_THREAD notifications run on a thread glibc starts for each event,
+// which may still be on its way after the notifier has been stopped. The
+// registry lets it check that its notifier is still alive, and the
+// notifier's own lock keeps it from draining a queue that is being closed.
+static pthread_mutex_t thread_notifiers_lock = PTHREAD_MUTEX_INITIALIZER;
+static mq_thread_notifier *thread_notifiers;
+
+typedef struct {
+  int32_t status;
+  uint32_t count;
+  char **messages;
+  size_t *lengths;
+  uint32_t *priorities;
+} notification_batch;
+
+void free_notification_batch(notification_batch *batch) {
+  for (uint32_t i = 0; i < batch->count; i++) {
+    free(batch->messages[i]);
+  }
+  free(batch->messages);
+  free(batch->lengths);
+  free(batch->priorities);
+  free(batch);
+}
+
+void release_thread_notifier(mq_thread_notifier *notifier) {
+  pthread_mutex_lock(&thread_notifiers_lock);
+  bool last_user = --notifier->users == 0;
+  pthread_mutex_unlock(&thread_notifiers_lock);
+  if (last_user) {
+    pthread_mutex_destroy(&notifier->lock);
+    free(notifier->scratch);
+    free(notifier);
+  }
+}
+
+// The hint carries the message length, which was reported to V8 the same
+// way as pooled chunks
+void free_message(napi_env env, void *data, void *hint) {
+  int64_t adjusted_value;
+  napi_adjust_external_memory(env, -(int64_t) (uintptr_t) hint, &adjusted_value);
+  free(data);
+}
+
+// Takes ownership of the malloc'd message whether or not the buffer is
+// created
+napi_status create_owned_buffer(napi_env env, char *message, size_t length, napi_value *result) {
+  napi_status status = napi_create_external_buffer(
+    env, length, message, free_message, (void *) (uintptr_t) length, result
+  );
+  if (status == napi_ok) {
+    int64_t adjusted_value;
+    return napi_adjust_external_memory(env, (int64_t) length, &adjusted_value);
+  }
+  if (status == napi_no_external_buffers_allowed)
+    status = napi_create_buffer_copy(env, length, message, NULL, result);
+  free(message);
+  return status;
+}
+
+void thread_notification_fired(union sigval value);
+
+int arm_thread_notification(mq_thread_notifier *notifier) {
+  struct sigevent notify_event = {
+    .sigev_notify = SIGEV_THREAD,
+    .sigev_notify_function = thread_notification_fired,
+    .sigev_value.sival_ptr = notifier
+  };
+  return mq_notify(notifier->descriptor, &notify_event) ? -errno : 0;
+}
+
+// Called with the notifier locked. Hands at most max_batch messages to JS;
+// the rest stay queued until JS has taken them and the drain resumes.
+void drain_to_js(mq_thread_notifier *notifier, int32_t status) {
+  if (notifier->batch_pending) {
+    return;
+  }
+  notification_batch *batch = calloc(1, sizeof(notification_batch));
+  if (batch == NULL) {
+    return;
+  }
+  batch->status = status;
+  batch->messages = malloc(notifier->max_batch * sizeof(char *));
+  batch->lengths = malloc(notifier->max_batch * sizeof(size_t));
+  batch->priorities = malloc(notifier->max_batch * sizeof(uint32_t));
+  if (batch->messages == NULL || batch->lengths == NULL || batch->priorities == NULL) {
+    free_notification_batch(batch);
+    return;
+  }
+
+  while (batch->count < notifier->max_batch) {
+    unsigned int priority;
+    ssize_t received_length = receive_until(
+      notifier->descriptor, notifier->scratch, notifier->message_size, &priority, &already_expired
+    );
+    if (received_length == -1) {
+      if (errno != EAGAIN && errno != ETIMEDOUT) {
+        batch->status = -errno;
+      }
+      break;
+    }
+    char *message = malloc(received_length > 0 ? received_length : 1);
+    if (message == NULL) {
+      batch->status = -ENOMEM;
+      break;
+    }
+    memcpy(message, notifier->scratch, received_length);
+    batch->messages[batch->count] = message;
+    batch->lengths[batch->count] = received_length;
+    batch->priorities[batch->count] = priority;
+    batch->count++;
+  }
+
+  if (batch->count == 0 && batch->status == 0) {
+    free_notification_batch(batch);
+    return;
+  }
+  // The batch keeps the notifier alive until it has been delivered
+  pthread_mutex_lock(&thread_notifiers_lock);
+  notifier->users++;
+  pthread_mutex_unlock(&thread_notifiers_lock);
+  if (napi_call_threadsafe_function(notifier->batches, batch, napi_tsfn_nonblocking) != napi_ok) {
+    free_notification_batch(batch);
+    release_thread_notifier(notifier);
+    return;
+  }
+  notifier->batch_pending = true;
+}
+
+// Re-arms before draining, since a message arriving after the drain would
+// otherwise go unnoticed until the next one
+void thread_notification_fired(union sigval value) {
+  mq_thread_notifier *notifier = NULL;
+  pthread_mutex_lock(&thread_notifiers_lock);
+  for (mq_thread_notifier *entry = thread_notifiers; entry != NULL; entry = entry->next) {
+    if (entry == value.sival_ptr) {
+      notifier = entry;
+      notifier->users++;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&thread_notifiers_lock);
+  if (notifier == NULL) {
+    return;
+  }
+
+  pthread_mutex_lock(&notifier->lock);
+  if (! notifier->stopped) {
+    drain_to_js(notifier, arm_thread_notification(notifier));
+  }
+  pthread_mutex_unlock(&notifier->lock);
+  release_thread_notifier(notifier);
+}
+
+void stop_thread_notifier(posix_mq *mq, bool release) {
+  mq_thread_notifier *notifier = mq->thread_notifier;
+  pthread_mutex_lock(&thread_notifiers_lock);
+  for (mq_thread_notifier **entry = &thread_notifiers; *entry != NULL; entry = &(*entry)->next) {
+    if (*entry == notifier) {
+      *entry = notifier->next;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&thread_notifiers_lock);
+
+  // Waits out a drain that is already running
+  pthread_mutex_lock(&notifier->lock);
+  notifier->stopped = true;
+  mq_notify(notifier->descriptor, NULL);
+  pthread_mutex_unlock(&notifier->lock);
+
+  if (release) {
+    napi_release_threadsafe_function(notifier->batches, napi_tsfn_release);
+  }
+  release_thread_notifier(notifier);
+  mq->thread_notifier = NULL;
+}
+
+typedef struct {
+  napi_async_work work;
+  mq_thread_notifier *notifier;
+} notifier_drain;
+
+void execute_notifier_drain(napi_env env, void *data) {
+  (void) env;
+  mq_thread_notifier *notifier = ((notifier_drain *) data)->notifier;
+  pthread_mutex_lock(&notifier->lock);
+  if (! notifier->stopped) {
+    drain_to_js(notifier, 0);
+  }
+  pthread_mutex_unlock(&notifier->lock);
+}
+
+void complete_notifier_drain(napi_env env, napi_status status, void *data) {
+  (void) status;
+  notifier_drain *drain = data;
+  napi_delete_async_work(env, drain->work);
+  release_thread_notifier(drain->notifier);
+  free(drain);
+}
+
+// Once JS has taken a batch, whatever else is queued is received on
+// libuv's pool. Takes over the reference the delivered batch held.
+void resume_notifier_drain(napi_env env, mq_thread_notifier *notifier) {
+  pthread_mutex_lock(&notifier->lock);
+  notifier->batch_pending = false;
+  bool stopped = notifier->stopped;
+  pthread_mutex_unlock(&notifier->lock);
+  if (stopped) {
+    release_thread_notifier(notifier);
+    return;
+  }
+
+  notifier_drain *drain = malloc(sizeof(notifier_drain));
+  napi_value resource_name;
+  napi_status status = drain == NULL ? napi_generic_failure : napi_ok;
+  if (status == napi_ok)
+    status = napi_create_string_utf8(env, "PosixMqNotifierDrain", NAPI_AUTO_LENGTH, &resource_name);
+  if (status == napi_ok)
+    status = napi_create_async_work(
+      env, NULL, resource_name, execute_notifier_drain, complete_notifier_drain, drain, &drain->work
+    );
+  if (status == napi_ok) {
+    drain->notifier = notifier;
+    status = napi_queue_async_work(env, drain->work);
+    if (status != napi_ok)
+      napi_delete_async_work(env, drain->work);
+  }
+  if (status != napi_ok) {
+    free(drain);
+    release_thread_notifier(notifier);
+  }
+}
+
+void deliver_notification_batch(napi_env env, napi_value callback, void *context, void *data) {
+  mq_thread_notifier *notifier = context;
+  notification_batch *batch = data;
+  if (env == NULL) {
+    free_notification_batch(batch);
+    release_thread_notifier(notifier);
+    return;
+  }
+
+  napi_value argv[3];
+  napi_status status = napi_create_int32(env, batch->status, &argv[0]);
+  if (status == napi_ok)
+    status = napi_create_array_with_length(env, batch->count, &argv[1]);
+  uint32_t *priorities = NULL;
+  napi_value priorities_buffer;
+  if (status == napi_ok)
+    status = napi_create_arraybuffer(
+      env, batch->count * sizeof(uint32_t), (void **) &priorities, &priorities_buffer
+    );
+  if (status == napi_ok)
+    status = napi_create_typedarray(
+      env, napi_uint32_array, batch->count, priorities_buffer, 0, &argv[2]
+    );
+
+  for (uint32_t i = 0; i < batch->count && status == napi_ok; i++) {
+    napi_value message;
+    status = create_owned_buffer(env, batch->messages[i], batch->lengths[i], &message);
+    batch->messages[i] = NULL;
+    if (status == napi_ok)
+      status = napi_set_element(env, argv[1], i, message);
+    priorities[i] = batch->priorities[i];
+  }
+  free_notification_batch(batch);
+
+  if (status != napi_ok) {
+    handle_error(env);
+  }
+  else {
+    napi_value global;
+    napi_value result;
+    status = napi_get_global(env, &global);
+    if (status == napi_ok)
+      status = napi_call_function(env, global, callback, 3, argv, &result);
+  }
+  if (status != napi_ok) {
+    bool is_pending;
+    napi_is_exception_pending(env, &is_pending);
+    if (is_pending) {
+      napi_value exception;
+      napi_get_and_clear_last_exception(env, &exception);
+      napi_fatal_exception(env, exception);
+    }
+  }
+  resume_notifier_drain(env, notifier);
+}
+
+napi_value notify_thread_posix_mq(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value argv[2];
+  posix_mq *mq;
+  napi_status status = get_posix_mq(env, info, &argc, argv, &mq);
+  HANDLE_ERROR(status)
+  HANDLE_CLOSED(mq)
+
+  uint32_t max_batch;
+  status = napi_get_value_uint32(env, argv[0], &max_batch);
+  HANDLE_ERROR(status)
+  if (max_batch == 0) {
+    napi_throw_range_error(env, NULL, "batch size must be greater than zero");
+    return NULL;
+  }
+
+  if (mq->thread_notifier != NULL) {
+    stop_thread_notifier(mq, true);
+  }
+
+  mq_thread_notifier *notifier = calloc(1, sizeof(mq_thread_notifier));
+  if (notifier == NULL) {
+    errno = ENOMEM;
+    return cerror_code(env);
+  }
+  pthread_mutex_init(&notifier->lock, NULL);
+  notifier->users = 1;
+  notifier->descriptor = mq->descriptor;
+  notifier->message_size = mq->attributes.mq_msgsize;
+  notifier->max_batch = max_batch;
+  notifier->scratch = malloc(notifier->message_size);
+  if (notifier->scratch == NULL) {
+    release_thread_notifier(notifier);
+    errno = ENOMEM;
+    return cerror_code(env);
+  }
+
+  napi_value resource_name;
+  status = napi_create_string_utf8(env, "PosixMqThreadNotifier", NAPI_AUTO_LENGTH, &resource_name);
+  if (status == napi_ok)
+    status = napi_create_threadsafe_function(
+      env,
+      argv[1],
+      NULL,
+      resource_name,
+      1,
+      1,
+      NULL,
+      NULL,
+      notifier,
+      deliver_notification_batch,
+      &notifier->batches
+    );
+  if (status != napi_ok) {
+    release_thread_notifier(notifier);
+    handle_error(env);
+    return NULL;
+  }
+
+  pthread_mutex_lock(&thread_notifiers_lock);
+  notifier->next = thread_notifiers;
+  thread_notifiers = notifier;
+  pthread_mutex_unlock(&thread_notifiers_lock);
+  mq->thread_notifier = notifier;
+
+  int error = -arm_thread_notification(notifier);
+  if (error != 0) {
+    stop_thread_notifier(mq, true);
+    errno = error;
+    return cerror_code(env);
+  }
+
+  // Messages already queued will not trigger a notification
+  pthread_mutex_lock(&notifier->lock);
+  drain_to_js(notifier, 0);
+  pthread_mutex_unlock(&notifier->lock);
+  return NULL;
+}
+
+napi_value unnotify_posix_mq(napi_env env, napi_callback_info info) {
+  size_t argc = 0;
+  posix_mq *mq;
+  napi_status status = get_posix_mq(env, info, &argc, NULL, &mq);
+  HANDLE_ERROR(status)
+
+  if (mq->notifier != NULL) {
+    stop_notifier(env, mq);
+  }
+  if (mq->thread_notifier != NULL) {
+    stop_thread_notifier(mq, true);
+  }
+  return NULL;
 }
 
 napi_value unlink_posix_mq(napi_env env, napi_callback_info info) {
@@ -371,88 +2387,210 @@ napi_value unlink_posix_mq(napi_env env, napi_callback_info info) {
   HANDLE_ERROR(status);
   
   if(mq_unlink(mq_name)) {
-    return cerror_name(env);
+    return cerror_code(env);
   }
   return NULL;
 }
 
+napi_value set_io_threads(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value argv[1];
+  napi_status status = napi_get_cb_info(env, info, &argc, argv, NULL, NULL);
+  HANDLE_ERROR(status)
+
+  uint32_t thread_count;
+  status = napi_get_value_uint32(env, argv[0], &thread_count);
+  HANDLE_ERROR(status)
+
+  module_state *state;
+  status = napi_get_instance_data(env, (void **) &state);
+  HANDLE_ERROR(status)
+  io_pool_resize(state->io_pool, thread_count);
+  return NULL;
+}
+
+napi_value allocator_stats(napi_env env, napi_callback_info info) {
+  (void) info;
+  module_state *state;
+  napi_status status = napi_get_instance_data(env, (void **) &state);
+  HANDLE_ERROR(status)
+
+  chunk_pool_stats stats;
+  chunk_pool_get_stats(state->receive_pool, &stats);
+
+  const struct {
+    const char *name;
+    size_t value;
+  } fields[] = {
+    {"poolBytes", stats.slab_bytes},
+    {"chunks", stats.chunk_count},
+    {"chunksInUse", stats.chunks_in_use},
+    {"peakChunksInUse", stats.peak_chunks_in_use},
+    {"bytesInUse", stats.bytes_in_use},
+    {"peakBytesInUse", stats.peak_bytes_in_use}
+  };
+
+  napi_value node_stats;
+  status = napi_create_object(env, &node_stats);
+  HANDLE_ERROR(status)
+  for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+    napi_value node_value;
+    status = napi_create_int64(env, fields[i].value, &node_value);
+    HANDLE_ERROR(status)
+    status = napi_set_named_property(env, node_stats, fields[i].name, node_value);
+    HANDLE_ERROR(status)
+  }
+  return node_stats;
+}
+
+void free_module_state(napi_env env, void *data, void *hint) {
+  (void) hint;
+  module_state *state = data;
+  napi_delete_reference(env, state->posix_mq_constructor);
+  chunk_pool_release(state->receive_pool);
+  io_pool_release(state->io_pool);
+  free(state);
+}
+
 NAPI_MODULE_INIT() {
+  napi_property_descriptor posix_mq_methods[] = {
+    {"close", NULL, close_posix_mq, NULL, NULL, NULL, napi_default, NULL},
+    {"attributes", NULL, get_message_queue_attributes, NULL, NULL, NULL, napi_default, NULL},
+    {"readAttributesInto", NULL, read_attributes_into_posix_mq, NULL, NULL, NULL, napi_default, NULL},
+    {"depth", NULL, depth_posix_mq, NULL, NULL, NULL, napi_default, NULL},
+    {"send", NULL, send_posix_mq, NULL, NULL, NULL, napi_default, NULL},
+    {"trySend", NULL, try_send_posix_mq, NULL, NULL, NULL, napi_default, NULL},
+    {"sendMany", NULL, send_many_posix_mq, NULL, NULL, NULL, napi_default, NULL},
+    {"sendv", NULL, sendv_posix_mq, NULL, NULL, NULL, napi_default, NULL},
+    {"sendString", NULL, send_string_posix_mq, NULL, NULL, NULL, napi_default, NULL},
+    {"sendAsync", NULL, send_posix_mq_async, NULL, NULL, NULL, napi_default, NULL},
+    {"receive", NULL, receive_posix_mq, NULL, NULL, NULL, napi_default, NULL},
+    {"receiveString", NULL, receive_string_posix_mq, NULL, NULL, NULL, napi_default, NULL},
+    {"receiveInto", NULL, receive_into_posix_mq, NULL, NULL, NULL, napi_default, NULL},
+    {"tryReceiveInto", NULL, try_receive_into_posix_mq, NULL, NULL, NULL, napi_default, NULL},
+    {"receiveMany", NULL, receive_many_posix_mq, NULL, NULL, NULL, napi_default, NULL},
+    {"receiveBatch", NULL, receive_batch_posix_mq, NULL, NULL, NULL, napi_default, NULL},
+    {"receiveAsync", NULL, receive_posix_mq_async, NULL, NULL, NULL, napi_default, NULL},
+    {"notify", NULL, notify_posix_mq, NULL, NULL, NULL, napi_default, NULL},
+    {"notifyThread", NULL, notify_thread_posix_mq, NULL, NULL, NULL, napi_default, NULL},
+    {"unnotify", NULL, unnotify_posix_mq, NULL, NULL, NULL, napi_default, NULL},
+    {"watch", NULL, watch_posix_mq, NULL, NULL, NULL, napi_default, NULL},
+    {"unwatch", NULL, unwatch_posix_mq, NULL, NULL, NULL, napi_default, NULL}
+  };
+  napi_value posix_mq_class;
+  napi_define_class(
+    env,
+    "PosixMqHandle",
+    NAPI_AUTO_LENGTH,
+    posix_mq_constructor,
+    NULL,
+    sizeof(posix_mq_methods) / sizeof(posix_mq_methods[0]),
+    posix_mq_methods,
+    &posix_mq_class
+  );
+
+  module_state *state = calloc(1, sizeof(module_state));
+  state->receive_pool = chunk_pool_create();
+
+  const char *io_threads_setting = getenv("POSMQ_THREADPOOL_SIZE");
+  int io_threads = io_threads_setting != NULL ? atoi(io_threads_setting) : 0;
+  state->io_pool = io_pool_create(io_threads > 0 ? io_threads : DEFAULT_IO_THREADS);
+  napi_value io_resource_name;
+  napi_create_string_utf8(env, "posixMqIo", NAPI_AUTO_LENGTH, &io_resource_name);
+  napi_create_threadsafe_function(
+    env,
+    NULL,
+    NULL,
+    io_resource_name,
+    0,
+    1,
+    NULL,
+    NULL,
+    state,
+    deliver_async_operation,
+    &state->io_completions
+  );
+  napi_unref_threadsafe_function(env, state->io_completions);
+  napi_create_reference(env, posix_mq_class, 1, &state->posix_mq_constructor);
+  napi_set_instance_data(env, state, free_module_state, NULL);
+
+  napi_value errno_name_fn;
+  napi_create_function(
+    env,
+    "errnoName",
+    NAPI_AUTO_LENGTH,
+    errno_name,
+    NULL,
+    &errno_name_fn
+  );
+  napi_set_named_property(env, exports, "errnoName", errno_name_fn);
+
   napi_value mq_unlink_fn;
   napi_create_function(
-    env, 
-    "posixMqUnlink", 
-    NAPI_AUTO_LENGTH, 
-    unlink_posix_mq, 
-    NULL, 
+    env,
+    "posixMqUnlink",
+    NAPI_AUTO_LENGTH,
+    unlink_posix_mq,
+    NULL,
     &mq_unlink_fn
   );
   napi_set_named_property(env, exports, "posixMqUnlink", mq_unlink_fn);
 
-  napi_value mq_notify_fn;
+  napi_value stats_many_fn;
   napi_create_function(
-    env, 
-    "posixMqNotify", 
-    NAPI_AUTO_LENGTH, 
-    get_message_queue_attributes, 
-    NULL, 
-    &mq_notify_fn
+    env,
+    "statsMany",
+    NAPI_AUTO_LENGTH,
+    stats_many_posix_mq,
+    NULL,
+    &stats_many_fn
   );
-  napi_set_named_property(env, exports, "posixMqNotify", mq_notify_fn);
+  napi_set_named_property(env, exports, "statsMany", stats_many_fn);
 
-  napi_value mq_attributes_fn;
+  napi_value set_io_threads_fn;
   napi_create_function(
-    env, 
-    "posixMqAttributes", 
-    NAPI_AUTO_LENGTH, 
-    get_message_queue_attributes, 
-    NULL, 
-    &mq_attributes_fn
+    env,
+    "setIoThreads",
+    NAPI_AUTO_LENGTH,
+    set_io_threads,
+    NULL,
+    &set_io_threads_fn
+  );
+  napi_set_named_property(env, exports, "setIoThreads", set_io_threads_fn);
+
+  napi_value allocator_stats_fn;
+  napi_create_function(
+    env,
+    "allocatorStats",
+    NAPI_AUTO_LENGTH,
+    allocator_stats,
+    NULL,
+    &allocator_stats_fn
   );
-  napi_set_named_property(env, exports, "posixMqAttributes", mq_attributes_fn);
+  napi_set_named_property(env, exports, "allocatorStats", allocator_stats_fn);
 
   napi_value open_mq_fn;
   napi_create_function(
-    env, 
-    "openPosixMq", 
-    NAPI_AUTO_LENGTH, 
-    open_posix_mq, 
-    NULL, 
+    env,
+    "openPosixMq",
+    NAPI_AUTO_LENGTH,
+    open_posix_mq,
+    NULL,
     &open_mq_fn
   );
   napi_set_named_property(env, exports, "openPosixMq", open_mq_fn);
-  
-  napi_value close_mq_fn;
-  napi_create_function(
-    env, 
-    "closePosixMq", 
-    NAPI_AUTO_LENGTH, 
-    close_posix_mq, 
-    NULL, 
-    &close_mq_fn
-  );
-  napi_set_named_property(env, exports, "closePosixMq", close_mq_fn);
-  
-  napi_value send_mq_fn;
-  napi_create_function(
-    env, 
-    "sendPosixMq", 
-    NAPI_AUTO_LENGTH, 
-    send_posix_mq, 
-    NULL, 
-    &send_mq_fn
-  );
-  napi_set_named_property(env, exports, "sendPosixMq", send_mq_fn);
-  
-  napi_value receive_mq_fn;
-  napi_create_function(
-    env, 
-    "receivePosixMq", 
-    NAPI_AUTO_LENGTH, 
-    receive_posix_mq, 
-    NULL, 
-    &receive_mq_fn
-  );
-  napi_set_named_property(env, exports, "receivePosixMq", receive_mq_fn);
-  
+
+  napi_value poll_readable;
+  napi_create_int32(env, UV_READABLE, &poll_readable);
+  napi_set_named_property(env, exports, "POLL_READABLE", poll_readable);
+
+  napi_value notify_signal;
+  napi_create_int32(env, notify_signal_number(), &notify_signal);
+  napi_set_named_property(env, exports, "NOTIFY_SIGNAL", notify_signal);
+
+  napi_value poll_writable;
+  napi_create_int32(env, UV_WRITABLE, &poll_writable);
+  napi_set_named_property(env, exports, "POLL_WRITABLE", poll_writable);
+
   return exports;
-}
\ No newline at end of file
+}
@@ -4,7 +4,30 @@
 napi_status get_string(napi_env env, napi_value node_string, char **string);
 void handle_error(napi_env env);
 void handle_cerror(napi_env env);
+napi_value cerror_code(napi_env env);
+napi_value errno_name(napi_env env, napi_callback_info info);
+napi_value read_attributes_into_posix_mq(napi_env env, napi_callback_info info);
+napi_value depth_posix_mq(napi_env env, napi_callback_info info);
+napi_value stats_many_posix_mq(napi_env env, napi_callback_info info);
 napi_value open_posix_mq(napi_env env, napi_callback_info info);
 napi_value close_posix_mq(napi_env env, napi_callback_info info);
 napi_value send_posix_mq(napi_env env, napi_callback_info info);
-napi_value receive_posix_mq(napi_env env, napi_callback_info info);
\ No newline at end of file
+napi_value try_send_posix_mq(napi_env env, napi_callback_info info);
+napi_value receive_posix_mq(napi_env env, napi_callback_info info);
+napi_value receive_string_posix_mq(napi_env env, napi_callback_info info);
+napi_value receive_into_posix_mq(napi_env env, napi_callback_info info);
+napi_value try_receive_into_posix_mq(napi_env env, napi_callback_info info);
+napi_value receive_many_posix_mq(napi_env env, napi_callback_info info);
+napi_value receive_batch_posix_mq(napi_env env, napi_callback_info info);
+napi_value send_many_posix_mq(napi_env env, napi_callback_info info);
+napi_value sendv_posix_mq(napi_env env, napi_callback_info info);
+napi_value send_string_posix_mq(napi_env env, napi_callback_info info);
+napi_value receive_posix_mq_async(napi_env env, napi_callback_info info);
+napi_value send_posix_mq_async(napi_env env, napi_callback_info info);
+napi_value notify_posix_mq(napi_env env, napi_callback_info info);
+napi_value notify_thread_posix_mq(napi_env env, napi_callback_info info);
+napi_value unnotify_posix_mq(napi_env env, napi_callback_info info);
+napi_value watch_posix_mq(napi_env env, napi_callback_info info);
+napi_value unwatch_posix_mq(napi_env env, napi_callback_info info);
+napi_value set_io_threads(napi_env env, napi_callback_info info);
+napi_value allocator_stats(napi_env env, napi_callback_info info);
\ No newline at end of file